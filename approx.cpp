@@ -0,0 +1,97 @@
+#include "approx.h"
+#include "telemetry.h"
+
+#include <cmath>   // For std::fabs
+#include <cstdint>
+#include <cstring> // For std::memcmp
+#include <map>
+#include <vector>
+
+namespace {
+
+// One group of configs sharing a signature
+struct Group {
+    std::uint64_t hash;
+    const FrontierTable::Entry* signature; // nullptr marks an empty slot
+    std::size_t signature_len;
+    const FrontierTable::Entry* best;      // Most probable member, points into the source table
+    std::size_t best_len;
+    double best_prob;
+    double total_prob;
+};
+
+} // namespace
+
+void coarse_signature(const FrontierTable::Entry* config, std::size_t len, int cutoff, Config& signature) {
+    // Exact large subtrees, then (0, small leaf mass); size 0 never occurs in a real config
+    signature.clear();
+    long long small_mass = 0;
+    for (std::size_t i = 0; i < len; ++i) {
+        if (config[i].first < cutoff) {
+            small_mass += static_cast<long long>(config[i].first) * config[i].second;
+        } else {
+            signature.push_back(config[i]);
+        }
+    }
+    signature.insert(signature.begin(), {0, static_cast<int>(small_mass)});
+}
+
+FrontierTable coarsen_frontier(const FrontierTable& frontier, int cutoff) {
+    using Entry = FrontierTable::Entry;
+
+    std::size_t capacity = 16;
+    while (capacity < 2 * frontier.size()) {
+        capacity <<= 1;
+    }
+    const FrontierLayout& layout = frontier.layout();
+    std::vector<Group, HugePageAllocator<Group>> groups(capacity, Group{0, nullptr, 0, nullptr, 0, 0.0, 0.0},
+                                                       HugePageAllocator<Group>(layout.hugepages));
+    std::size_t mask = capacity - 1;
+    std::size_t num_groups = 0;
+    KeyArena signatures(layout.arena_block_bytes, layout.hugepages);
+    Config signature;
+
+    frontier.for_each([&](const Entry* config, std::size_t len, double prob) {
+        coarse_signature(config, len, cutoff, signature);
+        std::uint64_t hash = FrontierTable::hash_config(signature.data(), signature.size());
+        std::size_t pos = hash & mask;
+        while (groups[pos].signature != nullptr) {
+            Group& group = groups[pos];
+            if (group.hash == hash && group.signature_len == signature.size()
+                && std::memcmp(group.signature, signature.data(), signature.size() * sizeof(Entry)) == 0) {
+                group.total_prob += prob;
+                if (prob > group.best_prob) {
+                    group.best = config;
+                    group.best_len = len;
+                    group.best_prob = prob;
+                }
+                return;
+            }
+            pos = (pos + 1) & mask;
+        }
+        const Entry* stored = signatures.store(signature.data(), signature.size());
+        groups[pos] = Group{hash, stored, signature.size(), config, len, prob, prob};
+        ++num_groups;
+    });
+
+    telemetry().approx_merged_configs += static_cast<long long>(frontier.size() - num_groups);
+
+    FrontierTable coarse(num_groups, layout);
+    for (const Group& group : groups) {
+        if (group.signature != nullptr) {
+            coarse.add(group.best, group.best_len, group.total_prob);
+        }
+    }
+    return coarse;
+}
+
+double total_variation(const Histogram& a, const Histogram& b) {
+    std::map<int, double> diff;
+    for (const auto& [value, prob] : a) diff[value] += prob;
+    for (const auto& [value, prob] : b) diff[value] -= prob;
+    double l1 = 0.0;
+    for (const auto& [value, delta] : diff) {
+        l1 += std::fabs(delta);
+    }
+    return l1 / 2;
+}
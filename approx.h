@@ -0,0 +1,33 @@
+#ifndef APPROX_H
+#define APPROX_H
+
+#include "frontier.h"   // For FrontierTable
+#include "tree_utils.h" // For Histogram
+
+/**
+ * @brief Computes the coarse signature coarsen_frontier groups configs by.
+ * @param signature Receives (0, leaves in subtrees below cutoff) followed by the larger subtrees.
+ */
+void coarse_signature(const FrontierTable::Entry* config, std::size_t len, int cutoff, Config& signature);
+
+/**
+ * @brief Merges configs that agree on a coarse signature.
+ *
+ * The signature of a config is the exact multiset of subtrees with at least
+ * cutoff leaves, plus the total number of leaves in subtrees below the cutoff.
+ * Each group is replaced by its most probable member, carrying the group's total
+ * probability. The number of revealed nodes, and thus the final histogram, changes
+ * only through how the small leaf mass is split up, so the error is controlled by
+ * the cutoff. No probability mass is dropped.
+ * @param frontier The exact frontier.
+ * @param cutoff Subtrees smaller than this are only tracked by total leaf mass.
+ * @return The coarsened frontier.
+ */
+FrontierTable coarsen_frontier(const FrontierTable& frontier, int cutoff);
+
+/**
+ * @brief Total-variation distance between two histograms: half the L1 distance.
+ */
+double total_variation(const Histogram& a, const Histogram& b);
+
+#endif // APPROX_H
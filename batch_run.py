@@ -1,13 +1,21 @@
 import argparse
 import subprocess
 import csv
+import os
+import time
 from itertools import product
-from concurrent.futures import ThreadPoolExecutor
+from concurrent.futures import ThreadPoolExecutor, wait, FIRST_COMPLETED
 from pathlib import Path
 from datetime import datetime
 
+# 共享目录工作队列的子目录（格式见 work_queue.h）
+QUEUE_SUBDIRS = ('pending', 'leased', 'results', 'failed')
+
+# 两种模式共用的输出列；队列模式拿不到峰值RSS，该列留空
+CSV_HEADER = ['lambda', 'tau', 'w_grind', 't_open_1_8', 't_open_1_4', 't_open_1_2', 'peak_rss_mb']
+
 def run_benchmark(lambda_val, tau, benchmark_bin):
-    """运行基准测试程序并返回第二行CSV数据"""
+    """运行基准测试程序，返回 (CSV结果行, 峰值RSS字节数)；峰值取自 my_app 的 telemetry 输出"""
     cmd = [
         str(benchmark_bin),
         str(lambda_val),
@@ -22,13 +30,131 @@ def run_benchmark(lambda_val, tau, benchmark_bin):
             text=True,
             timeout=3000  # 50分钟超时
         )
-        return result.stdout
+        peak_rss = None
+        for line in result.stderr.splitlines():
+            if line.startswith('Telemetry peak_rss_bytes = '):
+                peak_rss = int(line.split('=')[1])
+        return result.stdout, peak_rss
     except subprocess.CalledProcessError as e:
         print(f"Error running {' '.join(cmd)}:\n{e.stderr}")
-        return None
+        return None, None
     except Exception as e:
         print(f"Unexpected error with {' '.join(cmd)}: {str(e)}")
+        return None, None
+
+def read_finished(csv_path):
+    """读取已有输出CSV中的结果行，返回 {(lambda, tau, w_grind): 峰值RSS字节数或None}；文件不存在时返回 None"""
+    if not csv_path.exists() or csv_path.stat().st_size == 0:
         return None
+    text = csv_path.read_text()
+    if not text.endswith('\n'):
+        # 上次运行在写一行的中途崩溃：去掉不完整的最后一行，该点会重新计算
+        text = text[:text.rfind('\n') + 1]
+        csv_path.write_text(text)
+    header = text.split('\n', 1)[0].split(',')
+    if header != CSV_HEADER:
+        raise SystemExit(f'{csv_path} has columns {header}, expected {CSV_HEADER}; use another --output')
+    finished = {}
+    for row in csv.DictReader(text.splitlines()):
+        if not row.get('t_open_1_2'):
+            continue
+        rss_mb = row.get('peak_rss_mb')
+        point = (int(row['lambda']), int(row['tau']), int(row['w_grind']))
+        finished[point] = float(rss_mb) * 2**20 if rss_mb else None
+    return finished
+
+def open_output(csv_path):
+    """打开输出CSV用于追加，返回 (文件, 已完成的点)；文件不存在时先写表头"""
+    finished = read_finished(csv_path)
+    if finished is None:
+        finished = {}
+        with csv_path.open('w', newline='') as f:
+            csv.writer(f).writerow(CSV_HEADER)
+    else:
+        print(f'Resuming {csv_path}: {len(finished)} points already done')
+    return csv_path.open('a', newline=''), finished
+
+def estimate_rss(point, reported, default_rss):
+    """估计参数点的峰值RSS：默认值与参数不大于它的已完成点的实测峰值中的最大者（后者是下界）"""
+    csp, tau, w_grind = point
+    dominated = [rss for (c, t, w), rss in reported.items()
+                 if rss is not None and c <= csp and t <= tau and w == w_grind]
+    return max(dominated + [default_rss])
+
+def point_name(csp, tau, w_grind):
+    """队列中参数点的文件名，与 SweepPoint::name() 一致"""
+    return f'csp{csp}_tau{tau}_w{w_grind}'
+
+def publish_points(queue_dir, points):
+    """把尚未完成、也未在队列中的参数点写入 pending/，返回新发布的数量"""
+    for sub in QUEUE_SUBDIRS:
+        (queue_dir / sub).mkdir(parents=True, exist_ok=True)
+    leased = {lease.split('@')[0] for lease in os.listdir(queue_dir / 'leased')}
+    published = 0
+    for point in points:
+        name = point_name(*point)
+        if (queue_dir / 'results' / name).exists() or (queue_dir / 'pending' / name).exists() or name in leased:
+            continue
+        # 先写临时文件再 rename，worker 不会看到半个文件
+        tmp = queue_dir / 'pending' / f'{name}.{os.getpid()}.tmp'
+        tmp.write_text(f'{point[0]} {point[1]} {point[2]}\n')
+        tmp.rename(queue_dir / 'pending' / name)
+        os.utime(queue_dir / 'pending' / name)  # 发布时刷新 mtime，领取后的租约从当前时间算起
+        (queue_dir / 'failed' / name).unlink(missing_ok=True)  # 上次失败的点重新发布
+        published += 1
+    return published
+
+def reclaim_expired(queue_dir, lease_seconds):
+    """把超时未续约的租约放回 pending/，与 worker 的回收逻辑相同"""
+    now = time.time()
+    for lease in os.listdir(queue_dir / 'leased'):
+        if lease.endswith('.tmp'):
+            continue
+        path = queue_dir / 'leased' / lease
+        try:
+            if now - path.stat().st_mtime <= lease_seconds:
+                continue
+            path.rename(queue_dir / 'pending' / lease.split('@')[0])  # 只有一个回收者会成功
+            print(f'Reclaimed expired lease {lease}')
+        except FileNotFoundError:
+            pass  # 已完成或已被别人回收
+
+def run_queue(args, points, csv_path):
+    """通过共享目录分发参数点：发布、启动本地 worker、回收过期租约，结果文件一出现就追加到CSV"""
+    f, finished = open_output(csv_path)
+    points = [point for point in points if point not in finished]
+    queue_dir = Path(args.queue_dir)
+    print(f'Published {publish_points(queue_dir, points)} of {len(points)} points to {queue_dir}')
+
+    # 其他机器上的 worker 可以随时加入: my_app --queue-worker <queue_dir>
+    cmd = [str(Path(args.benchmark_bin).absolute()), '--queue-worker', str(queue_dir),
+           '--lease-seconds', str(args.lease_seconds)]
+    workers = [subprocess.Popen(cmd) for _ in range(args.local_workers)]
+
+    writer = csv.writer(f)
+    waiting = {point_name(*point): point for point in points}
+    with f:
+        while True:
+            reclaim_expired(queue_dir, args.lease_seconds)
+            for name, point in list(waiting.items()):
+                result = queue_dir / 'results' / name
+                if result.exists():
+                    row = result.read_text().strip().split(',')
+                    writer.writerow(row[:2] + [point[2]] + row[2:] + [''])
+                    f.flush()  # 实时写入，中断后可续跑
+                    del waiting[name]
+                elif (queue_dir / 'failed' / name).exists():
+                    print(f'{name} failed: {(queue_dir / "failed" / name).read_text().strip()}')
+                    del waiting[name]
+            if not waiting:
+                break
+            if workers and all(worker.poll() is not None for worker in workers) \
+                    and not os.listdir(queue_dir / 'pending') and not os.listdir(queue_dir / 'leased'):
+                print('Local workers exited with points unfinished')
+                break
+            time.sleep(args.poll_seconds)
+    for worker in workers:
+        worker.wait()
 
 def main():
     parser = argparse.ArgumentParser(description='One-Tree-Sampler参数空间搜索工具')
@@ -42,51 +168,79 @@ def main():
                       help='基准测试程序路径')
     parser.add_argument('--threads', '-j', type=int, default=4,
                       help='并行工作线程数')
+    parser.add_argument('--rss-budget-mb', type=float, default=float('inf'),
+                      help='同时运行的参数点估计峰值RSS之和的上限（MB），默认不限')
+    parser.add_argument('--default-rss-mb', type=float, default=1024,
+                      help='没有可参考的实测峰值时对一个参数点的RSS估计（MB）')
+    parser.add_argument('--queue-dir',
+                      help='共享目录工作队列；设置后参数点以租约文件发布，由任意机器上的 my_app --queue-worker 领取')
+    parser.add_argument('--local-workers', type=int, default=None,
+                      help='--queue-dir 模式下在本机启动的 worker 数（默认等于 --threads，0 表示只等待远程 worker）')
+    parser.add_argument('--lease-seconds', type=int, default=300,
+                      help='租约超时秒数，超时未续约的参数点会被重新领取')
+    parser.add_argument('--poll-seconds', type=float, default=5,
+                      help='--queue-dir 模式下检查进度的间隔')
     
     args = parser.parse_args()
+    if args.local_workers is None:
+        args.local_workers = args.threads
     
     # 定义参数空间
     lambdas = [40]
     taus = range(10, 11) # 0-20, 21个值
+    w_grinds = [0]
     
     # 准备CSV文件
     csv_path = Path(args.output)
     csv_path.parent.mkdir(parents=True, exist_ok=True)
     
-    with csv_path.open('w', newline='') as f:
-        writer = csv.writer(f)
-        # 写入表头
-        writer.writerow([
-            'lambda', 'tau', 't_open_1_8', 't_open_1_4', 't_open_1_2'
-        ])
-    
-    # 生成所有参数组合
+    if args.queue_dir:
+        run_queue(args, list(product(lambdas, taus, w_grinds)), csv_path)
+        return
+
+    # 生成所有参数组合；my_app 的命令行不带 w_grind，普通模式只跑 w_grind = 0
     param_combinations = []
     for csp in lambdas:
         for tau in taus:
-            param_combinations.append((csp, tau))
+            param_combinations.append((csp, tau, 0))
+
+    # 输出文件已存在时续跑：跳过其中已有的参数点，新结果追加在后面
+    f, finished = open_output(csv_path)
+    todo = [point for point in param_combinations if point not in finished]
 
     # param_combinations = product(lambdas, taus, w_grinds, rej_diffs)
-    # 使用线程池并行执行
-    with ThreadPoolExecutor(max_workers=args.threads) as executor:
-        futures = []
-        for lambda_val, tau in param_combinations:
-            futures.append(
-                executor.submit(
-                    run_benchmark,
-                    lambda_val,
-                    tau,
-                    Path(args.benchmark_bin).absolute()
-                )
-            )
-        
-        # 收集结果并写入CSV
-        with csv_path.open('a', newline='') as f:  # 追加模式
-            writer = csv.writer(f)
-            for future in futures:
-                result = future.result()
+    # 使用线程池并行执行；按 RSS 预算准入，预算内同时运行的点的估计峰值之和不超过 --rss-budget-mb
+    budget = args.rss_budget_mb * 2**20
+    default_rss = args.default_rss_mb * 2**20
+    reported = dict(finished)
+    benchmark_bin = Path(args.benchmark_bin).absolute()
+    with ThreadPoolExecutor(max_workers=args.threads) as executor, f:  # 追加模式
+        writer = csv.writer(f)
+        running = {}  # future -> (参数点, 预留的RSS)
+        reserved = 0
+        while todo or running:
+            # 按顺序准入，直到下一个点放不进预算；没有在运行的点时总是准入一个，避免卡死
+            while todo and len(running) < args.threads:
+                estimate = estimate_rss(todo[0], reported, default_rss)
+                if running and reserved + estimate > budget:
+                    break
+                point = todo.pop(0)
+                future = executor.submit(run_benchmark, point[0], point[1], benchmark_bin)
+                running[future] = (point, estimate)
+                reserved += estimate
+
+            # 收集结果并按完成顺序写入CSV
+            done, _ = wait(running, return_when=FIRST_COMPLETED)
+            for future in done:
+                point, estimate = running.pop(future)
+                reserved -= estimate
+                result, peak_rss = future.result()
+                if peak_rss is not None:
+                    reported[point] = peak_rss
                 if result:
-                    writer.writerow(result.strip().split(','))
+                    rss_mb = f'{peak_rss / 2**20:.1f}' if peak_rss is not None else ''
+                    row = result.strip().split(',')
+                    writer.writerow(row[:2] + [point[2]] + row[2:] + [rss_mb])
                     f.flush()  # 实时写入
 
 if __name__ == "__main__":
@@ -0,0 +1,267 @@
+#include "checkpoint.h"
+#include "telemetry.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>    // For std::rename, std::remove
+#include <cstring>   // For std::memcpy, std::strerror
+#include <fstream>
+#include <stdexcept> // For std::runtime_error
+#include <cerrno>
+#include <fcntl.h>   // For open
+#include <unistd.h>  // For write, fsync, close
+
+namespace {
+
+const char kMagic[8] = {'O', 'T', 'S', 'C', 'K', 'P', 'T', '1'};
+
+long long elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+AsyncCheckpointWriter::AsyncCheckpointWriter(std::size_t queue_blocks, std::size_t block_bytes)
+    : queue_blocks_(queue_blocks == 0 ? 1 : queue_blocks), block_bytes_(block_bytes) {
+    block_.reserve(block_bytes_);
+    thread_ = std::thread(&AsyncCheckpointWriter::run, this);
+}
+
+AsyncCheckpointWriter::~AsyncCheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    not_empty_.notify_all();
+    thread_.join();
+    if (fd_ >= 0) {
+        close(fd_); // Abandoned checkpoint; the .tmp file is left behind
+    }
+}
+
+void AsyncCheckpointWriter::begin(const std::string& path, int num_leaf, int step, std::size_t num_configs) {
+    // The previous checkpoint may still be syncing; jobs run in order, so no need to wait for it
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_.empty()) {
+            throw std::runtime_error(error_);
+        }
+    }
+    path_ = path;
+    submit({Job::Open, {}, path_});
+    block_.clear();
+    std::int32_t header_leaf = num_leaf;
+    std::int32_t header_step = step;
+    std::uint64_t header_configs = num_configs;
+    put(kMagic, sizeof(kMagic));
+    put(&header_leaf, sizeof(header_leaf));
+    put(&header_step, sizeof(header_step));
+    put(&header_configs, sizeof(header_configs));
+}
+
+void AsyncCheckpointWriter::append(const std::pair<int, int>* config, std::size_t len, double prob) {
+    std::uint32_t header_len = static_cast<std::uint32_t>(len);
+    put(&header_len, sizeof(header_len));
+    put(&prob, sizeof(prob));
+    for (std::size_t i = 0; i < len; ++i) {
+        std::int32_t pair[2] = {config[i].first, config[i].second};
+        put(pair, sizeof(pair));
+    }
+}
+
+void AsyncCheckpointWriter::commit() {
+    submit_block();
+    submit({Job::Commit, {}, path_});
+}
+
+void AsyncCheckpointWriter::discard() {
+    block_.clear();
+    submit({Job::Discard, {}, path_});
+}
+
+void AsyncCheckpointWriter::wait() {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [&] { return queue_.empty() && !busy_; });
+    telemetry().io_stall_ns += elapsed_ns(start);
+    if (!error_.empty()) {
+        std::string error = error_;
+        error_.clear();
+        throw std::runtime_error(error);
+    }
+}
+
+void AsyncCheckpointWriter::put(const void* bytes, std::size_t size) {
+    const char* src = static_cast<const char*>(bytes);
+    block_.insert(block_.end(), src, src + size);
+    if (block_.size() >= block_bytes_) {
+        submit_block();
+    }
+}
+
+void AsyncCheckpointWriter::submit_block() {
+    if (block_.empty()) {
+        return;
+    }
+    std::vector<char> full;
+    full.reserve(block_bytes_);
+    full.swap(block_);
+    submit({Job::Data, std::move(full), {}});
+}
+
+void AsyncCheckpointWriter::submit(Job job) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // Only data blocks count against the bound; control jobs are tiny
+        not_full_.wait(lock, [&] { return job.kind != Job::Data || queue_.size() < queue_blocks_; });
+        queue_.push_back(std::move(job));
+    }
+    telemetry().io_stall_ns += elapsed_ns(start);
+    not_empty_.notify_one();
+}
+
+void AsyncCheckpointWriter::fail(const std::string& what) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_.empty()) {
+        error_ = what + ": " + std::strerror(errno);
+    }
+}
+
+void AsyncCheckpointWriter::run() {
+    Telemetry& stats = telemetry();
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return; // stop_ requested and nothing left to do
+            }
+            job = std::move(queue_.front());
+            queue_.pop_front();
+            busy_ = true;
+        }
+        not_full_.notify_one();
+
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed = !error_.empty();
+        }
+        // After an error, drain the queue without touching the file
+        if (!failed) {
+            auto start = std::chrono::steady_clock::now();
+            if (job.kind == Job::Open) {
+                fd_ = open((job.path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd_ < 0) fail("Cannot open checkpoint " + job.path + ".tmp");
+            } else if (job.kind == Job::Data) {
+                const char* src = job.data.data();
+                std::size_t left = job.data.size();
+                while (left > 0) {
+                    ssize_t written = write(fd_, src, left);
+                    if (written < 0) {
+                        if (errno == EINTR) continue;
+                        fail("Checkpoint write failed");
+                        break;
+                    }
+                    src += written;
+                    left -= static_cast<std::size_t>(written);
+                }
+                stats.io_bytes_written += static_cast<long long>(job.data.size() - left);
+                stats.io_write_ns += elapsed_ns(start);
+            } else if (job.kind == Job::Discard) {
+                close(fd_);
+                fd_ = -1;
+                std::remove((job.path + ".tmp").c_str());
+            } else {
+                if (fsync(fd_) != 0) fail("Checkpoint fsync failed");
+                stats.io_fsync_ns += elapsed_ns(start);
+                close(fd_);
+                fd_ = -1;
+                if (std::rename((job.path + ".tmp").c_str(), job.path.c_str()) != 0) {
+                    fail("Cannot rename checkpoint to " + job.path);
+                } else {
+                    stats.checkpoints += 1;
+                }
+            }
+        } else if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_ = false;
+        }
+        idle_.notify_all();
+    }
+}
+
+void load_checkpoint(const std::string& path, int& num_leaf, int& step, FrontierTable& frontier) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open checkpoint " + path);
+    }
+    char magic[sizeof(kMagic)];
+    std::int32_t header_leaf = 0;
+    std::int32_t header_step = 0;
+    std::uint64_t header_configs = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&header_leaf), sizeof(header_leaf));
+    in.read(reinterpret_cast<char*>(&header_step), sizeof(header_step));
+    in.read(reinterpret_cast<char*>(&header_configs), sizeof(header_configs));
+    if (!in || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("Not a checkpoint file: " + path);
+    }
+
+    // Sizes come from the file, so check them against what is left of it before allocating
+    constexpr std::uint64_t kConfigHeaderBytes = sizeof(std::uint32_t) + sizeof(double);
+    constexpr std::uint64_t kPairBytes = 2 * sizeof(std::int32_t);
+    std::streamoff header_end = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff file_end = in.tellg();
+    in.seekg(header_end);
+    if (!in || header_end < 0 || file_end < header_end) {
+        throw std::runtime_error("Bad checkpoint " + path + ": cannot determine its size");
+    }
+    std::uint64_t remaining = static_cast<std::uint64_t>(file_end - header_end);
+    if (header_configs > remaining / kConfigHeaderBytes) {
+        throw std::runtime_error("Bad checkpoint " + path + ": " + std::to_string(header_configs)
+                                 + " configs do not fit in " + std::to_string(remaining) + " bytes");
+    }
+
+    FrontierTable table(static_cast<std::size_t>(header_configs), frontier.layout());
+    Config config;
+    for (std::uint64_t i = 0; i < header_configs; ++i) {
+        std::uint32_t len = 0;
+        double prob = 0.0;
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        in.read(reinterpret_cast<char*>(&prob), sizeof(prob));
+        if (!in.good() || remaining < kConfigHeaderBytes) {
+            throw std::runtime_error("Bad checkpoint " + path + ": truncated at config " + std::to_string(i));
+        }
+        remaining -= kConfigHeaderBytes;
+        if (len > remaining / kPairBytes) {
+            throw std::runtime_error("Bad checkpoint " + path + ": config " + std::to_string(i) + " has length "
+                                     + std::to_string(len) + " past the end of the file");
+        }
+        remaining -= len * kPairBytes;
+        config.resize(len);
+        for (auto& pair : config) {
+            std::int32_t fields[2];
+            in.read(reinterpret_cast<char*>(fields), sizeof(fields));
+            pair = {fields[0], fields[1]};
+        }
+        if (!in.good()) {
+            throw std::runtime_error("Bad checkpoint " + path + ": truncated at config " + std::to_string(i));
+        }
+        table.add(config, prob);
+    }
+    if (remaining != 0) {
+        throw std::runtime_error("Bad checkpoint " + path + ": " + std::to_string(remaining) + " trailing bytes");
+    }
+    num_leaf = header_leaf;
+    step = header_step;
+    frontier = std::move(table);
+}
@@ -0,0 +1,112 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "frontier.h" // For FrontierTable
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Writes frontier checkpoints on a dedicated I/O thread.
+ *
+ * The step loop serializes configs into fixed-size blocks and hands them to the
+ * writer through a bounded queue, so write() and fsync() overlap with the
+ * expansion of the next chunk. The step loop only blocks when the queue is full
+ * or when it waits for a commit; that time is reported as io_stall_ns.
+ *
+ * File layout (native endianness): the 8-byte magic "OTSCKPT1", int32 num_leaf,
+ * int32 step, uint64 num_configs, then per config: uint32 len, double prob and
+ * len (int32 size, int32 count) pairs. Files are written to "<path>.tmp" and
+ * renamed over path after fsync, so a crash never leaves a torn checkpoint.
+ */
+class AsyncCheckpointWriter {
+public:
+    /**
+     * @param queue_blocks Maximum number of serialized blocks waiting for the writer.
+     * @param block_bytes Size of each serialized block.
+     */
+    explicit AsyncCheckpointWriter(std::size_t queue_blocks = 8, std::size_t block_bytes = std::size_t(1) << 20);
+    ~AsyncCheckpointWriter();
+    AsyncCheckpointWriter(const AsyncCheckpointWriter&) = delete;
+    AsyncCheckpointWriter& operator=(const AsyncCheckpointWriter&) = delete;
+
+    /**
+     * @brief Starts a new checkpoint file, queued behind any previous commit.
+     *
+     * Throws std::runtime_error if an earlier checkpoint failed.
+     * @param path Final path of the checkpoint.
+     * @param num_leaf Number of leaves of the tree being sampled.
+     * @param step Number of steps already applied to the frontier.
+     * @param num_configs Number of configs that will be appended.
+     */
+    void begin(const std::string& path, int num_leaf, int step, std::size_t num_configs);
+
+    /**
+     * @brief Serializes one config into the current block, queueing the block when it is full.
+     */
+    void append(const std::pair<int, int>* config, std::size_t len, double prob);
+
+    /**
+     * @brief Queues the last block followed by fsync and rename. Does not wait.
+     */
+    void commit();
+
+    /**
+     * @brief Drops the checkpoint begun last, e.g. for a cancelled step. The previous one stays in place.
+     */
+    void discard();
+
+    /**
+     * @brief Blocks until everything queued so far is on disk.
+     *
+     * Throws std::runtime_error if the writer thread hit an I/O error.
+     */
+    void wait();
+
+private:
+    struct Job {
+        enum Kind { Open, Data, Commit, Discard } kind;
+        std::vector<char> data; // Block contents for Data
+        std::string path;       // Final path for Open, Commit and Discard
+    };
+
+    void put(const void* bytes, std::size_t size);
+    void submit(Job job);
+    void submit_block();
+    void run();
+    void fail(const std::string& what);
+
+    std::size_t queue_blocks_;
+    std::size_t block_bytes_;
+    std::vector<char> block_; // Block being filled by the step loop
+    std::string path_;
+
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::condition_variable idle_;
+    std::deque<Job> queue_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::string error_;
+    int fd_ = -1; // Owned by the writer thread
+    std::thread thread_;
+};
+
+/**
+ * @brief Loads a checkpoint written by AsyncCheckpointWriter.
+ * @param path The checkpoint file.
+ * @param num_leaf Receives the number of leaves the checkpoint was taken for.
+ * @param step Receives the number of steps already applied.
+ * @param frontier Receives the configs, in a table with its layout.
+ * Throws std::runtime_error on a missing or malformed file.
+ */
+void load_checkpoint(const std::string& path, int& num_leaf, int& step, FrontierTable& frontier);
+
+#endif // CHECKPOINT_H
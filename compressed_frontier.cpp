@@ -0,0 +1,109 @@
+#include "compressed_frontier.h"
+#include "hugepage.h"
+
+#include <algorithm> // For std::sort, std::lexicographical_compare, std::mismatch
+
+namespace {
+
+// Encoded blocks are packed into chunks of this size
+constexpr std::size_t kChunkBytes = 4 * kHugePageSize;
+
+void write_varint(std::vector<unsigned char>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+struct EntryRef {
+    const FrontierTable::Entry* key;
+    std::size_t len;
+    double prob;
+};
+
+// Collects the configs of a table in lexicographic order
+std::vector<EntryRef> sorted_refs(const FrontierTable& table) {
+    std::vector<EntryRef> refs;
+    refs.reserve(table.size());
+    table.for_each([&](const FrontierTable::Entry* config, std::size_t len, double prob) {
+        refs.push_back({config, len, prob});
+    });
+    std::sort(refs.begin(), refs.end(), [](const EntryRef& a, const EntryRef& b) {
+        return std::lexicographical_compare(a.key, a.key + a.len, b.key, b.key + b.len);
+    });
+    return refs;
+}
+
+// Appends refs[first, last) to out, each config delta-encoded against its predecessor
+void encode_run(const std::vector<EntryRef>& refs, std::size_t first, std::size_t last,
+                std::vector<unsigned char>& out) {
+    const EntryRef* prev = nullptr;
+    for (std::size_t r = first; r < last; ++r) {
+        const EntryRef& ref = refs[r];
+        std::size_t prefix = 0;
+        if (prev != nullptr) {
+            std::size_t limit = std::min(prev->len, ref.len);
+            prefix = static_cast<std::size_t>(
+                std::mismatch(ref.key, ref.key + limit, prev->key).first - ref.key);
+        }
+        write_varint(out, prefix);
+        write_varint(out, ref.len - prefix);
+        int last_size = prefix > 0 ? ref.key[prefix - 1].first : 0;
+        for (std::size_t k = prefix; k < ref.len; ++k) {
+            // Sizes are strictly increasing inside a config, so deltas are positive
+            write_varint(out, static_cast<std::uint64_t>(ref.key[k].first - last_size));
+            write_varint(out, static_cast<std::uint64_t>(ref.key[k].second));
+            last_size = ref.key[k].first;
+        }
+        const unsigned char* prob_bytes = reinterpret_cast<const unsigned char*>(&ref.prob);
+        out.insert(out.end(), prob_bytes, prob_bytes + sizeof(double));
+        prev = &ref;
+    }
+}
+
+} // namespace
+
+void encode_frontier(const FrontierTable& table, std::vector<unsigned char>& out) {
+    std::vector<EntryRef> refs = sorted_refs(table);
+    write_varint(out, refs.size());
+    encode_run(refs, 0, refs.size(), out);
+}
+
+CompressedFrontier::CompressedFrontier(const FrontierTable& table)
+    : size_(table.size()), hugepages_(table.layout().hugepages) {
+    std::vector<EntryRef> refs = sorted_refs(table);
+    std::vector<unsigned char> encoded;
+    blocks_.reserve((refs.size() + kBlockConfigs - 1) / kBlockConfigs);
+    for (std::size_t first = 0; first < refs.size(); first += kBlockConfigs) {
+        std::size_t last = std::min(first + kBlockConfigs, refs.size());
+        encoded.clear();
+        encode_run(refs, first, last, encoded);
+        blocks_.push_back({store(encoded), static_cast<std::uint32_t>(last - first),
+                           static_cast<std::uint32_t>(encoded.size())});
+    }
+}
+
+CompressedFrontier::~CompressedFrontier() {
+    for (const Chunk& chunk : chunks_) {
+        large_free(chunk.data, chunk.capacity);
+    }
+}
+
+const unsigned char* CompressedFrontier::store(const std::vector<unsigned char>& bytes) {
+    if (chunks_.empty() || chunk_used_ + bytes.size() > chunks_.back().capacity) {
+        std::size_t capacity = std::max(kChunkBytes, bytes.size());
+        chunks_.push_back({static_cast<unsigned char*>(large_alloc(capacity, hugepages_)), capacity});
+        chunk_used_ = 0;
+        reserved_bytes_ += capacity;
+    }
+    unsigned char* dst = chunks_.back().data + chunk_used_;
+    std::copy(bytes.begin(), bytes.end(), dst);
+    chunk_used_ += bytes.size();
+    encoded_bytes_ += bytes.size();
+    return dst;
+}
+
+std::size_t CompressedFrontier::memory_bytes() const {
+    return blocks_.capacity() * sizeof(Block) + reserved_bytes_;
+}
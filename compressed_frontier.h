@@ -0,0 +1,166 @@
+#ifndef COMPRESSED_FRONTIER_H
+#define COMPRESSED_FRONTIER_H
+
+#include "frontier.h" // For FrontierTable
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // For std::memcpy
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Reads one LEB128 varint and advances the pointer past it.
+ *
+ * Throws std::runtime_error if the varint would run past end or does not fit 64 bits.
+ */
+inline std::uint64_t read_varint(const unsigned char*& in, const unsigned char* end) {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in == end) {
+            throw std::runtime_error("Truncated encoded frontier");
+        }
+        unsigned char byte = *in++;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt encoded frontier: varint too long");
+}
+
+/**
+ * @brief Decodes count delta-encoded configs (see CompressedFrontier) from [in, end).
+ *
+ * Throws std::runtime_error if a config would run past end or refers to more shared
+ * pairs than its predecessor has.
+ * @param in Start of the run.
+ * @param end End of the bytes that may be read.
+ * @param count Number of configs in the run.
+ * @param current Scratch config; the first config of a run has no predecessor.
+ * @param fn Called as fn(const std::pair<int, int>* config, std::size_t len, double prob).
+ * @return Pointer just past the run.
+ */
+template <typename Fn>
+const unsigned char* decode_configs(const unsigned char* in, const unsigned char* end, std::size_t count,
+                                    Config& current, Fn& fn) {
+    current.clear();
+    for (std::size_t c = 0; c < count; ++c) {
+        std::uint64_t prefix = read_varint(in, end);
+        std::uint64_t suffix = read_varint(in, end);
+        if (prefix > current.size()) {
+            throw std::runtime_error("Corrupt encoded frontier: shared prefix longer than the previous config");
+        }
+        current.resize(static_cast<std::size_t>(prefix));
+        int last_size = prefix > 0 ? current.back().first : 0;
+        for (std::uint64_t k = 0; k < suffix; ++k) {
+            last_size += static_cast<int>(read_varint(in, end));
+            current.push_back({last_size, static_cast<int>(read_varint(in, end))});
+        }
+        if (static_cast<std::size_t>(end - in) < sizeof(double)) {
+            throw std::runtime_error("Truncated encoded frontier");
+        }
+        double prob;
+        std::memcpy(&prob, in, sizeof(prob));
+        in += sizeof(prob);
+        fn(current.data(), current.size(), prob);
+    }
+    return in;
+}
+
+/**
+ * @brief Appends all configs of a table to out as one sorted, delta-encoded run, preceded by a varint count.
+ */
+void encode_frontier(const FrontierTable& table, std::vector<unsigned char>& out);
+
+/**
+ * @brief Decodes a run written by encode_frontier that fills [in, end) exactly.
+ *
+ * Throws std::runtime_error if the run is truncated, corrupt or followed by trailing bytes.
+ */
+template <typename Fn>
+void decode_frontier(const unsigned char* in, const unsigned char* end, Fn&& fn) {
+    Config current;
+    std::uint64_t count = read_varint(in, end);
+    if (decode_configs(in, end, static_cast<std::size_t>(count), current, fn) != end) {
+        throw std::runtime_error("Corrupt encoded frontier: trailing bytes after the run");
+    }
+}
+
+/**
+ * @brief Read-only frontier stored as sorted, delta-encoded blocks.
+ *
+ * Configs are sorted lexicographically and grouped into blocks of kBlockConfigs.
+ * Inside a block each config is encoded against its predecessor as
+ *   varint shared_prefix_pairs, varint suffix_pairs,
+ *   per suffix pair: varint size_delta (from the previous size), varint count,
+ *   raw double prob.
+ * The first config of a block has no predecessor, so blocks decode independently.
+ * Sorted frontiers share long prefixes (the large subtrees), so a config usually
+ * costs a handful of bytes plus its probability, instead of 8 bytes per pair plus a
+ * 32-byte hash slot.
+ */
+class CompressedFrontier {
+public:
+    using Entry = FrontierTable::Entry;
+
+    static constexpr std::size_t kBlockConfigs = 128;
+
+    /**
+     * @brief Sorts and encodes all configs of a table.
+     */
+    explicit CompressedFrontier(const FrontierTable& table);
+    ~CompressedFrontier();
+    CompressedFrontier(const CompressedFrontier&) = delete;
+    CompressedFrontier& operator=(const CompressedFrontier&) = delete;
+
+    /**
+     * @brief Returns the number of configs.
+     */
+    std::size_t size() const { return size_; }
+
+    /**
+     * @brief Returns the number of bytes held by the chunks of encoded blocks and the block index.
+     */
+    std::size_t memory_bytes() const;
+
+    /**
+     * @brief Returns the number of bytes of encoded configs, without chunk slack.
+     */
+    std::size_t encoded_bytes() const { return encoded_bytes_; }
+
+    /**
+     * @brief Decodes every config in sorted order, calling fn(const Entry* config, std::size_t len, double prob).
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        Config current;
+        for (const Block& block : blocks_) {
+            decode_configs(block.data, block.data + block.bytes, block.count, current, fn);
+        }
+    }
+
+private:
+    struct Block {
+        const unsigned char* data;
+        std::uint32_t count; // Configs in the block
+        std::uint32_t bytes; // Encoded size of the block
+    };
+    struct Chunk {
+        unsigned char* data;
+        std::size_t capacity;
+    };
+
+    const unsigned char* store(const std::vector<unsigned char>& bytes);
+
+    std::vector<Block> blocks_;
+    std::vector<Chunk> chunks_; // Backing storage from large_alloc
+    std::size_t chunk_used_ = 0;
+    std::size_t encoded_bytes_ = 0;
+    std::size_t reserved_bytes_ = 0; // Capacity of chunks_
+    std::size_t size_ = 0;
+    HugePagePolicy hugepages_; // Taken from the source table's layout
+};
+
+#endif // COMPRESSED_FRONTIER_H
@@ -0,0 +1,200 @@
+#include "early_abort.h"
+#include "monte_carlo.h" // For run_challenge_streams
+#include "tree_utils.h"  // For heap_depth
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_set>
+
+namespace {
+
+// Computes emitted[i], the revealed nodes emitted once the i-th leaf in DFS order has been
+// processed (i = 1..n), with emitted[0] = 0 and emitted[n + 1] the total after the final sweep
+class EmissionProfile {
+public:
+    explicit EmissionProfile(long long num_leaf) : max_depth_(heap_depth(2 * num_leaf - 1)) {}
+
+    const std::vector<int>& compute(std::vector<long long>& leaves) {
+        // Left-aligned to the deepest level, keys order nodes by DFS position
+        auto first_key = [this](long long node) { return node << (max_depth_ - heap_depth(node)); };
+        auto last_key = [this](long long node) { return ((node + 1) << (max_depth_ - heap_depth(node))) - 1; };
+        std::sort(leaves.begin(), leaves.end(),
+                  [&](long long a, long long b) { return first_key(a) < first_key(b); });
+
+        on_path_.clear();
+        for (long long leaf : leaves) {
+            for (long long node = leaf; node >= 1 && on_path_.insert(node).second; node >>= 1) {
+            }
+        }
+        // A node is revealed once the walk is past its last leaf
+        revealed_ends_.clear();
+        for (long long node : on_path_) {
+            if (node > 1 && on_path_.count(node ^ 1) == 0) {
+                revealed_ends_.push_back(last_key(node ^ 1));
+            }
+        }
+        if (leaves.empty()) {
+            revealed_ends_.push_back(last_key(1)); // Nothing opened: the root is revealed
+        }
+        std::sort(revealed_ends_.begin(), revealed_ends_.end());
+
+        emitted_.assign(1, 0);
+        std::size_t passed = 0;
+        for (long long leaf : leaves) {
+            while (passed < revealed_ends_.size() && revealed_ends_[passed] < first_key(leaf)) {
+                ++passed;
+            }
+            emitted_.push_back(static_cast<int>(passed));
+        }
+        emitted_.push_back(static_cast<int>(revealed_ends_.size()));
+        return emitted_;
+    }
+
+private:
+    int max_depth_;
+    std::unordered_set<long long> on_path_;
+    std::vector<long long> revealed_ends_;
+    std::vector<int> emitted_;
+};
+
+// Adapts an accumulator of add(emitted, opened) to run_challenge_streams; each thread gets its own profile
+template <typename Accumulator>
+struct ProfiledChallenges {
+    EmissionProfile profile;
+    int opened;
+    Accumulator sums;
+
+    void add(std::vector<long long>& leaves) { sums.add(profile.compute(leaves), opened); }
+    void merge(const ProfiledChallenges& other) { sums.merge(other.sums); }
+};
+
+// Runs add(emitted, opened) of a copy of prototype for every challenge
+template <typename Accumulator>
+Accumulator run_challenges(long long num_leaf, int tau, std::uint64_t samples, std::uint64_t seed, int threads,
+                           const Accumulator& prototype) {
+    if (num_leaf <= 0 || tau < 0 || samples == 0) {
+        throw std::invalid_argument("Invalid early-abort parameters");
+    }
+    int opened = static_cast<int>(std::min<long long>(tau, num_leaf));
+    ProfiledChallenges<Accumulator> profiled{EmissionProfile(num_leaf), opened, prototype};
+    return run_challenge_streams(num_leaf, tau, samples, seed, threads, profiled).sums;
+}
+
+// Per-threshold sums, kept as difference arrays over the threshold
+struct SweepSums {
+    std::vector<double> rejected;        // Difference array of rejected attempts
+    std::vector<double> rejected_leaves; // Difference array of their leaves processed
+    std::vector<double> accepted;        // Attempts with exactly this many revealed nodes
+    std::vector<double> accepted_nodes;
+
+    void grow(std::size_t size) {
+        if (size > accepted.size()) {
+            rejected.resize(size, 0.0);
+            rejected_leaves.resize(size, 0.0);
+            accepted.resize(size, 0.0);
+            accepted_nodes.resize(size, 0.0);
+        }
+    }
+
+    void add(const std::vector<int>& emitted, int opened) {
+        int total = emitted.back();
+        grow(static_cast<std::size_t>(total) + 2);
+        accepted[static_cast<std::size_t>(total)] += 1;
+        accepted_nodes[static_cast<std::size_t>(total)] += total;
+        // For emitted[i - 1] <= threshold < emitted[i] the walk aborts while processing leaf i
+        for (std::size_t i = 1; i < emitted.size(); ++i) {
+            if (emitted[i] == emitted[i - 1]) continue;
+            double leaves = static_cast<double>(std::min<std::size_t>(i, static_cast<std::size_t>(opened)));
+            rejected[static_cast<std::size_t>(emitted[i - 1])] += 1;
+            rejected[static_cast<std::size_t>(emitted[i])] -= 1;
+            rejected_leaves[static_cast<std::size_t>(emitted[i - 1])] += leaves;
+            rejected_leaves[static_cast<std::size_t>(emitted[i])] -= leaves;
+        }
+    }
+
+    void merge(const SweepSums& other) {
+        grow(other.accepted.size());
+        for (std::size_t i = 0; i < other.accepted.size(); ++i) {
+            rejected[i] += other.rejected[i];
+            rejected_leaves[i] += other.rejected_leaves[i];
+            accepted[i] += other.accepted[i];
+            accepted_nodes[i] += other.accepted_nodes[i];
+        }
+    }
+};
+
+struct OutcomeCounts {
+    int threshold;
+    std::map<std::tuple<bool, int, int>, std::uint64_t> counts;
+
+    void add(const std::vector<int>& emitted, int opened) {
+        std::size_t step = 1;
+        while (step < emitted.size() && emitted[step] <= threshold) {
+            ++step;
+        }
+        if (step == emitted.size()) {
+            ++counts[{true, opened, emitted.back()}];
+        } else {
+            ++counts[{false, std::min(static_cast<int>(step), opened), threshold + 1}];
+        }
+    }
+
+    void merge(const OutcomeCounts& other) {
+        for (const auto& [key, count] : other.counts) {
+            counts[key] += count;
+        }
+    }
+};
+
+} // namespace
+
+std::vector<AbortSummary> simulate_early_abort(long long num_leaf, int tau, std::uint64_t samples,
+                                               std::uint64_t seed, int threads) {
+    SweepSums sums = run_challenges(num_leaf, tau, samples, seed, threads, SweepSums());
+    double n = static_cast<double>(samples);
+    double opened = static_cast<double>(std::min<long long>(tau, num_leaf));
+    double mean_nodes = 0;
+    for (std::size_t total = 0; total < sums.accepted.size(); ++total) {
+        mean_nodes += sums.accepted_nodes[total] / n;
+    }
+
+    std::vector<AbortSummary> rows;
+    double rejected = 0, rejected_leaves = 0, accepted = 0, accepted_nodes = 0;
+    for (std::size_t threshold = 0; threshold + 1 < sums.accepted.size(); ++threshold) {
+        rejected += sums.rejected[threshold];
+        rejected_leaves += sums.rejected_leaves[threshold];
+        accepted += sums.accepted[threshold];
+        accepted_nodes += sums.accepted_nodes[threshold];
+        if (accepted == 0) continue; // No signature is ever accepted below the smallest count
+
+        AbortSummary row;
+        row.threshold = static_cast<int>(threshold);
+        row.accept_prob = accepted / n;
+        row.rejected_leaves = rejected > 0 ? rejected_leaves / rejected : 0.0;
+        row.accepted_leaves = opened;
+        row.accepted_nodes = accepted_nodes / accepted;
+        row.expected_attempts = 1.0 / row.accept_prob;
+        // Geometric number of attempts: (1 - p) / p rejected ones, then one accepted
+        double rejects = (1 - row.accept_prob) * row.expected_attempts;
+        row.total_leaves = rejects * row.rejected_leaves + opened;
+        row.total_nodes = rejects * (threshold + 1) + row.accepted_nodes;
+        row.full_leaves = row.expected_attempts * opened;
+        row.full_nodes = row.expected_attempts * mean_nodes;
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+std::vector<AbortOutcome> early_abort_distribution(long long num_leaf, int tau, int threshold,
+                                                   std::uint64_t samples, std::uint64_t seed, int threads) {
+    OutcomeCounts prototype{threshold, {}};
+    OutcomeCounts counts = run_challenges(num_leaf, tau, samples, seed, threads, prototype);
+    std::vector<AbortOutcome> outcomes;
+    for (const auto& [key, count] : counts.counts) {
+        outcomes.push_back({std::get<0>(key), std::get<1>(key), std::get<2>(key),
+                            static_cast<double>(count) / static_cast<double>(samples)});
+    }
+    return outcomes;
+}
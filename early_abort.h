@@ -0,0 +1,63 @@
+#ifndef EARLY_ABORT_H
+#define EARLY_ABORT_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Signing work at one T_open threshold, with and without early abort.
+ *
+ * An attempt is accepted if its opening reveals at most threshold nodes. Work is
+ * counted in leaves processed and revealed nodes emitted; rejected attempts emit
+ * threshold + 1 nodes before aborting.
+ */
+struct AbortSummary {
+    int threshold;
+    double accept_prob;
+    double rejected_leaves;   // Mean leaves processed by a rejected attempt
+    double accepted_leaves;   // Always tau
+    double accepted_nodes;    // Mean nodes emitted by an accepted attempt
+    double expected_attempts; // 1 / accept_prob
+    double total_leaves;      // Expected leaves processed per signature, with early abort
+    double total_nodes;       // Expected nodes emitted per signature, with early abort
+    double full_leaves;       // The same without early abort
+    double full_nodes;
+};
+
+/**
+ * @brief One cell of the work distribution at a fixed threshold.
+ */
+struct AbortOutcome {
+    bool accepted;
+    int leaves; // Leaves processed before acceptance or abort
+    int nodes;  // Nodes emitted
+    double prob;
+};
+
+/**
+ * @brief Simulates early-abort openings for every threshold at once.
+ *
+ * The signer walks the opened leaves in DFS order and emits a revealed node as soon as
+ * the walk has passed its subtree, so the running count only grows and ends at the
+ * number of revealed nodes. The walk stops as soon as the count exceeds the threshold:
+ * while processing the first leaf whose left-side nodes push it over, or at the final
+ * right-side sweep. Challenges are drawn as in sample_monte_carlo (ChallengeStream).
+ * @param num_leaf Number of leaves of the tree.
+ * @param tau Number of opened leaves per challenge.
+ * @param samples Number of challenges to simulate.
+ * @param seed Seed of the challenge streams.
+ * @param threads Worker threads; the result does not depend on it.
+ * @return One row per threshold from 0 to the largest revealed count seen.
+ */
+std::vector<AbortSummary> simulate_early_abort(long long num_leaf, int tau, std::uint64_t samples,
+                                               std::uint64_t seed, int threads = 1);
+
+/**
+ * @brief Distribution of (outcome, leaves processed, nodes emitted) at one threshold.
+ *
+ * Same model and challenges as simulate_early_abort.
+ */
+std::vector<AbortOutcome> early_abort_distribution(long long num_leaf, int tau, int threshold,
+                                                   std::uint64_t samples, std::uint64_t seed, int threads = 1);
+
+#endif // EARLY_ABORT_H
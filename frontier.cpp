@@ -0,0 +1,196 @@
+#include "frontier.h"
+
+#include <algorithm> // For std::clamp
+#include <atomic>
+#include <cstring>   // For std::memcpy, std::memcmp
+#include <stdexcept> // For std::length_error
+
+namespace {
+
+// Keep the table at most half full by default so probe sequences stay short
+std::atomic<int> g_max_load_percent{50};
+std::atomic<std::size_t> g_arena_block_bytes{4 * kHugePageSize};
+
+std::size_t slots_for(std::size_t expected_size, std::size_t max_load_percent) {
+    std::size_t capacity = 16;
+    while (capacity * max_load_percent < expected_size * 100) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+} // namespace
+
+void set_arena_block_bytes(std::size_t bytes) {
+    g_arena_block_bytes.store(std::max<std::size_t>(bytes, 4096), std::memory_order_relaxed);
+}
+
+std::size_t get_arena_block_bytes() {
+    return g_arena_block_bytes.load(std::memory_order_relaxed);
+}
+
+void set_frontier_max_load(int percent) {
+    g_max_load_percent.store(std::clamp(percent, 10, 90), std::memory_order_relaxed);
+}
+
+int get_frontier_max_load() {
+    return g_max_load_percent.load(std::memory_order_relaxed);
+}
+
+FrontierLayout FrontierLayout::defaults() {
+    return {get_frontier_max_load(), get_arena_block_bytes(), get_hugepage_policy()};
+}
+
+KeyArena::KeyArena(std::size_t block_bytes, HugePagePolicy policy)
+    : block_bytes_(std::max<std::size_t>(block_bytes, 4096)), policy_(policy) {}
+
+KeyArena::~KeyArena() {
+    release();
+}
+
+KeyArena::KeyArena(KeyArena&& other) noexcept
+    : block_bytes_(other.block_bytes_), policy_(other.policy_), blocks_(std::move(other.blocks_)),
+      used_(other.used_), reserved_(other.reserved_), stored_(other.stored_) {
+    other.blocks_.clear();
+    other.used_ = 0;
+    other.reserved_ = 0;
+    other.stored_ = 0;
+}
+
+KeyArena& KeyArena::operator=(KeyArena&& other) noexcept {
+    if (this != &other) {
+        release();
+        block_bytes_ = other.block_bytes_;
+        policy_ = other.policy_;
+        blocks_ = std::move(other.blocks_);
+        used_ = other.used_;
+        reserved_ = other.reserved_;
+        stored_ = other.stored_;
+        other.blocks_.clear();
+        other.used_ = 0;
+        other.reserved_ = 0;
+        other.stored_ = 0;
+    }
+    return *this;
+}
+
+void KeyArena::release() {
+    for (const Block& block : blocks_) {
+        large_free(block.data, block.capacity * sizeof(Entry));
+    }
+    blocks_.clear();
+    used_ = 0;
+    reserved_ = 0;
+    stored_ = 0;
+}
+
+const KeyArena::Entry* KeyArena::store(const Entry* config, std::size_t len) {
+    if (blocks_.empty() || used_ + len > blocks_.back().capacity) {
+        std::size_t capacity = block_bytes_ / sizeof(Entry);
+        if (capacity < len) {
+            capacity = len;
+        }
+        auto* data = static_cast<Entry*>(large_alloc(capacity * sizeof(Entry), policy_));
+        blocks_.push_back({data, capacity});
+        used_ = 0;
+        reserved_ += capacity * sizeof(Entry);
+    }
+    Entry* dst = blocks_.back().data + used_;
+    std::memcpy(static_cast<void*>(dst), config, len * sizeof(Entry));
+    used_ += len;
+    stored_ += len;
+    return dst;
+}
+
+FrontierTable::FrontierTable(std::size_t expected_size, const FrontierLayout& layout)
+    : slots_(HugePageAllocator<Slot>(layout.hugepages)), layout_(layout),
+      max_load_percent_(static_cast<std::size_t>(std::clamp(layout.max_load_percent, 10, 90))),
+      keys_(layout.arena_block_bytes, layout.hugepages) {
+    slots_.assign(slots_for(expected_size, max_load_percent_), Slot{0, nullptr, 0, 0.0});
+    mask_ = slots_.size() - 1;
+}
+
+std::uint64_t FrontierTable::hash_config(const Entry* config, std::size_t len) {
+    std::uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    for (std::size_t i = 0; i < len; ++i) {
+        std::uint64_t word = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(config[i].first)) << 32)
+                           | static_cast<std::uint32_t>(config[i].second);
+        h = (h ^ word) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    // Final avalanche (fmix64 from MurmurHash3)
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void FrontierTable::add_hashed(std::uint64_t hash, const Entry* config, std::size_t len, double prob) {
+    if (len > UINT32_MAX) {
+        throw std::length_error("Config too long for FrontierTable");
+    }
+    std::size_t pos = hash & mask_;
+    while (true) {
+        Slot& slot = slots_[pos];
+        if (slot.key == nullptr) {
+            break;
+        }
+        if (slot.hash == hash && slot.len == len
+            && std::memcmp(slot.key, config, len * sizeof(Entry)) == 0) {
+            slot.prob += prob;
+            return;
+        }
+        pos = (pos + 1) & mask_;
+    }
+
+    if ((size_ + 1) * 100 > slots_.size() * max_load_percent_) {
+        grow();
+        // Find the new empty slot after rehashing
+        pos = hash & mask_;
+        while (slots_[pos].key != nullptr) {
+            pos = (pos + 1) & mask_;
+        }
+    }
+    slots_[pos] = Slot{hash, keys_.store(config, len), static_cast<std::uint32_t>(len), prob};
+    ++size_;
+}
+
+void FrontierTable::grow() {
+    std::vector<Slot, HugePageAllocator<Slot>> old_slots(slots_.size() * 2, Slot{0, nullptr, 0, 0.0},
+                                                         slots_.get_allocator());
+    old_slots.swap(slots_);
+    mask_ = slots_.size() - 1;
+    // Keys live in the arena, so only the slots move
+    for (const Slot& slot : old_slots) {
+        if (slot.key == nullptr) {
+            continue;
+        }
+        std::size_t pos = slot.hash & mask_;
+        while (slots_[pos].key != nullptr) {
+            pos = (pos + 1) & mask_;
+        }
+        slots_[pos] = slot;
+    }
+}
+
+std::size_t FrontierTable::memory_bytes() const {
+    return slots_.size() * sizeof(Slot) + keys_.reserved_bytes();
+}
+
+BatchedInserter::BatchedInserter(FrontierTable& table, std::size_t batch_size)
+    : table_(table), batch_size_(batch_size) {
+    if (batch_size_ > 1) {
+        pending_.reserve(batch_size_);
+    }
+}
+
+void BatchedInserter::flush() {
+    for (const Pending& item : pending_) {
+        table_.prefetch_key(item.hash);
+    }
+    for (const Pending& item : pending_) {
+        table_.add_hashed(item.hash, keys_.data() + item.offset, item.len, item.prob);
+    }
+    pending_.clear();
+    keys_.clear();
+}
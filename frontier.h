@@ -0,0 +1,297 @@
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include "hugepage.h"
+#include "tree_utils.h" // For Config, Distribution
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Sets the process-wide default block size of KeyArena, in bytes.
+ * @param bytes The new block size. Only affects arenas created afterwards without an explicit size.
+ */
+void set_arena_block_bytes(std::size_t bytes);
+
+/**
+ * @brief Returns the current KeyArena block size (default 8 MB).
+ */
+std::size_t get_arena_block_bytes();
+
+/**
+ * @brief Sets the process-wide default maximum load of FrontierTable slot arrays, in percent.
+ * @param percent The new maximum load, clamped to 10..90. Only affects tables created afterwards
+ *                with FrontierLayout::defaults().
+ */
+void set_frontier_max_load(int percent);
+
+/**
+ * @brief Returns the current maximum load of FrontierTable slot arrays (default 50%).
+ */
+int get_frontier_max_load();
+
+/**
+ * @brief Allocation knobs of a FrontierTable, fixed when the table is created.
+ *
+ * Tables take these from their creator rather than from the process-wide settings
+ * above, so engines with different options can run side by side.
+ */
+struct FrontierLayout {
+    int max_load_percent;          // Clamped to 10..90
+    std::size_t arena_block_bytes; // At least 4096
+    HugePagePolicy hugepages;
+
+    /**
+     * @brief The process-wide settings.
+     */
+    static FrontierLayout defaults();
+};
+
+/**
+ * @brief Bump allocator for config keys, carved out of large_alloc blocks.
+ *
+ * Keys are never freed individually; the whole arena is released with the table.
+ * Pointers handed out stay valid until then, so the hash table can store them directly.
+ */
+class KeyArena {
+public:
+    using Entry = std::pair<int, int>;
+
+    explicit KeyArena(std::size_t block_bytes = get_arena_block_bytes(),
+                      HugePagePolicy policy = get_hugepage_policy());
+    ~KeyArena();
+    KeyArena(KeyArena&& other) noexcept;
+    KeyArena& operator=(KeyArena&& other) noexcept;
+    KeyArena(const KeyArena&) = delete;
+    KeyArena& operator=(const KeyArena&) = delete;
+
+    /**
+     * @brief Copies a config into the arena.
+     * @param config Pointer to the (size, count) pairs.
+     * @param len Number of pairs.
+     * @return Pointer to the stored copy.
+     */
+    const Entry* store(const Entry* config, std::size_t len);
+
+    /**
+     * @brief Returns the number of bytes reserved from large_alloc.
+     */
+    std::size_t reserved_bytes() const { return reserved_; }
+
+    /**
+     * @brief Returns the number of bytes taken by stored keys.
+     */
+    std::size_t used_bytes() const { return stored_ * sizeof(Entry); }
+
+private:
+    struct Block {
+        Entry* data;
+        std::size_t capacity; // In entries
+    };
+    void release();
+
+    std::size_t block_bytes_;
+    HugePagePolicy policy_;
+    std::vector<Block> blocks_;
+    std::size_t used_ = 0; // Entries used in the last block
+    std::size_t reserved_ = 0;
+    std::size_t stored_ = 0; // Entries stored over all blocks
+};
+
+/**
+ * @brief Open-addressing hash table mapping configs to probabilities.
+ *
+ * This is the engine's frontier representation. Slots and keys come from
+ * large_alloc so that multi-GB frontiers are backed by huge pages.
+ */
+class FrontierTable {
+public:
+    using Entry = KeyArena::Entry;
+
+    /**
+     * @brief Creates an empty table.
+     * @param expected_size Number of configs to size the slot array for.
+     * @param layout Allocation knobs of this table.
+     */
+    explicit FrontierTable(std::size_t expected_size = 0, const FrontierLayout& layout = FrontierLayout::defaults());
+
+    FrontierTable(FrontierTable&&) noexcept = default;
+    FrontierTable& operator=(FrontierTable&&) noexcept = default;
+    FrontierTable(const FrontierTable&) = delete;
+    FrontierTable& operator=(const FrontierTable&) = delete;
+
+    /**
+     * @brief Adds probability mass to a config, inserting it if it is new.
+     * @param config Pointer to the sorted (size, count) pairs.
+     * @param len Number of pairs.
+     * @param prob Probability to add.
+     */
+    void add(const Entry* config, std::size_t len, double prob) {
+        add_hashed(hash_config(config, len), config, len, prob);
+    }
+
+    /**
+     * @brief Same as add, with the hash already computed by hash_config.
+     */
+    void add_hashed(std::uint64_t hash, const Entry* config, std::size_t len, double prob);
+
+    /**
+     * @brief Prefetches the home slot of a hash into cache ahead of an insert.
+     */
+    void prefetch(std::uint64_t hash) const {
+        __builtin_prefetch(&slots_[hash & mask_], 1, 1);
+    }
+
+    /**
+     * @brief Prefetches the key stored in the home slot of a hash, if any.
+     *
+     * Only useful once the slot itself is in cache (after prefetch); it hides the
+     * second miss of the key comparison on a hit.
+     */
+    void prefetch_key(std::uint64_t hash) const {
+        const Slot& slot = slots_[hash & mask_];
+        if (slot.key != nullptr) {
+            __builtin_prefetch(slot.key, 0, 1);
+        }
+    }
+
+    /**
+     * @brief Convenience overload of add for a Config.
+     */
+    void add(const Config& config, double prob) { add(config.data(), config.size(), prob); }
+
+    /**
+     * @brief Returns the number of distinct configs in the table.
+     */
+    std::size_t size() const { return size_; }
+
+    /**
+     * @brief Returns the number of bytes held by the slot array and the key arena.
+     *
+     * Counts whole arena blocks (KeyArena::reserved_bytes), not just the stored keys,
+     * so it matches what the table has actually allocated.
+     */
+    std::size_t memory_bytes() const;
+
+    /**
+     * @brief Returns the allocation knobs the table was created with.
+     */
+    const FrontierLayout& layout() const { return layout_; }
+
+    /**
+     * @brief Calls fn(const Entry* config, std::size_t len, double prob) for every config.
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const Slot& slot : slots_) {
+            if (slot.key != nullptr) {
+                fn(slot.key, static_cast<std::size_t>(slot.len), slot.prob);
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the number of slots, the index space of for_each_slot.
+     */
+    std::size_t slot_count() const { return slots_.size(); }
+
+    /**
+     * @brief Calls fn like for_each, for the configs in slots [begin, end) only.
+     *
+     * Disjoint slot ranges can be visited from different threads.
+     */
+    template <typename Fn>
+    void for_each_slot(std::size_t begin, std::size_t end, Fn&& fn) const {
+        for (std::size_t i = begin; i < end && i < slots_.size(); ++i) {
+            const Slot& slot = slots_[i];
+            if (slot.key != nullptr) {
+                fn(slot.key, static_cast<std::size_t>(slot.len), slot.prob);
+            }
+        }
+    }
+
+    /**
+     * @brief Hashes a config.
+     */
+    static std::uint64_t hash_config(const Entry* config, std::size_t len);
+
+private:
+    struct Slot {
+        std::uint64_t hash;
+        const Entry* key; // nullptr marks an empty slot
+        std::uint32_t len;
+        double prob;
+    };
+
+    void grow();
+
+    std::vector<Slot, HugePageAllocator<Slot>> slots_;
+    std::size_t mask_ = 0;
+    std::size_t size_ = 0;
+    FrontierLayout layout_;
+    std::size_t max_load_percent_; // Grow once size_ exceeds this share of the slots
+    KeyArena keys_;
+};
+
+/**
+ * @brief Buffers inserts into a FrontierTable and applies them in groups.
+ *
+ * Each buffered transition is hashed and its home slot prefetched immediately;
+ * when the group is full, the stored keys of those slots are prefetched in a
+ * second pass and only then are the inserts performed. With batch_size transitions
+ * in flight, up to batch_size cache misses overlap instead of serializing.
+ * A batch_size of 1 degenerates to plain FrontierTable::add.
+ *
+ * The destructor does not flush, so a step abandoned by an exception leaves the
+ * queued transitions alone; the success path must call flush().
+ */
+class BatchedInserter {
+public:
+    using Entry = FrontierTable::Entry;
+
+    BatchedInserter(FrontierTable& table, std::size_t batch_size);
+    ~BatchedInserter() noexcept = default; // Drops queued transitions: call flush() once done
+    BatchedInserter(const BatchedInserter&) = delete;
+    BatchedInserter& operator=(const BatchedInserter&) = delete;
+
+    /**
+     * @brief Queues a transition, flushing the group when it is full.
+     */
+    void add(const Entry* config, std::size_t len, double prob) {
+        if (batch_size_ <= 1) {
+            table_.add(config, len, prob);
+            return;
+        }
+        std::uint64_t hash = FrontierTable::hash_config(config, len);
+        table_.prefetch(hash);
+        pending_.push_back({hash, keys_.size(), len, prob});
+        keys_.insert(keys_.end(), config, config + len);
+        if (pending_.size() >= batch_size_) {
+            flush();
+        }
+    }
+
+    void add(const Config& config, double prob) { add(config.data(), config.size(), prob); }
+
+    /**
+     * @brief Applies all queued transitions to the table.
+     */
+    void flush();
+
+private:
+    struct Pending {
+        std::uint64_t hash;
+        std::size_t offset; // Into keys_
+        std::size_t len;
+        double prob;
+    };
+
+    FrontierTable& table_;
+    std::size_t batch_size_;
+    std::vector<Pending> pending_;
+    std::vector<Entry> keys_; // Keys of the queued transitions, back to back
+};
+
+#endif // FRONTIER_H
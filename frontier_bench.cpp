@@ -0,0 +1,80 @@
+// Microbenchmark for FrontierTable inserts: unbatched vs. batched/prefetched.
+//
+// Inserts a stream of synthetic configs (with repeats, like a real step where
+// many transitions land on the same successor) into a table far larger than
+// the last-level cache, and reports throughput per insert batch size.
+
+#include "frontier.h"
+#include "hugepage.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+std::uint64_t splitmix64(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Derives a sorted config of 4..11 entries from a key id, so the benchmark
+// does not add misses of its own by reading keys from a big array.
+void make_key(std::uint64_t id, Config& out) {
+    out.clear();
+    std::uint64_t bits = splitmix64(id);
+    int len = 4 + static_cast<int>(bits & 7);
+    int size = 1;
+    for (int i = 0; i < len; ++i) {
+        bits = splitmix64(bits);
+        size += 1 + static_cast<int>(bits % 64);
+        out.push_back({size, 1 + static_cast<int>((bits >> 8) % 4)});
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using namespace std::chrono;
+    std::size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (std::size_t(1) << 22);
+    std::size_t num_inserts = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4 * num_keys;
+    HugePagePolicy policy = HugePagePolicy::Madvise;
+    if (argc > 3 && !parse_hugepage_policy(argv[3], policy)) {
+        std::cerr << "Usage: " << argv[0] << " [num_keys] [num_inserts] [off|madvise|hugetlb]" << std::endl;
+        return 1;
+    }
+    set_hugepage_policy(policy);
+
+    std::cout << "keys = " << num_keys << " inserts = " << num_inserts
+              << " hugepages = " << hugepage_policy_name(get_hugepage_policy()) << std::endl;
+    std::cout << "batch,ms,ns_per_insert,minserts_per_s" << std::endl;
+
+    Config key;
+    double baseline_ns = 0.0;
+    for (std::size_t batch : {1, 4, 8, 16, 32, 64, 128}) {
+        FrontierTable table(num_keys);
+        auto start = steady_clock::now();
+        {
+            BatchedInserter inserter(table, batch);
+            std::uint64_t state = 12345;
+            for (std::size_t i = 0; i < num_inserts; ++i) {
+                state = splitmix64(state);
+                make_key(state % num_keys, key);
+                inserter.add(key, 1.0);
+            }
+            inserter.flush();
+        }
+        double ms = duration<double, std::milli>(steady_clock::now() - start).count();
+        double ns = ms * 1e6 / static_cast<double>(num_inserts);
+        if (batch == 1) {
+            baseline_ns = ns;
+        }
+        std::cout << batch << "," << ms << "," << ns << "," << 1e3 / ns
+                  << "  (speedup " << baseline_ns / ns << "x, " << table.size() << " configs)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "hugepage.h"
+#include "telemetry.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h> // For mmap, munmap, madvise
+
+namespace {
+
+std::atomic<HugePagePolicy> g_policy{HugePagePolicy::Madvise};
+
+// Round up to a whole number of huge pages so mappings can be trimmed to 2 MB alignment
+std::size_t round_to_huge_page(std::size_t bytes) {
+    return (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+// Decided by size alone so large_free agrees with large_alloc even if the policy changed in between
+bool use_mapping(std::size_t bytes) {
+    return bytes >= kHugePageSize;
+}
+
+// Maps `bytes` (a multiple of kHugePageSize) at a 2 MB-aligned address.
+// Over-maps by one huge page and unmaps the unaligned head and tail.
+void* map_aligned(std::size_t bytes) {
+    std::size_t padded = bytes + kHugePageSize;
+    void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    auto base = reinterpret_cast<std::uintptr_t>(raw);
+    auto aligned = (base + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    std::size_t head = aligned - base;
+    std::size_t tail = padded - head - bytes;
+    if (head > 0) munmap(raw, head);
+    if (tail > 0) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+    return reinterpret_cast<void*>(aligned);
+}
+
+} // namespace
+
+void set_hugepage_policy(HugePagePolicy policy) {
+    g_policy.store(policy, std::memory_order_relaxed);
+}
+
+HugePagePolicy get_hugepage_policy() {
+    return g_policy.load(std::memory_order_relaxed);
+}
+
+bool parse_hugepage_policy(const std::string& name, HugePagePolicy& policy) {
+    if (name == "off") {
+        policy = HugePagePolicy::Off;
+    } else if (name == "madvise") {
+        policy = HugePagePolicy::Madvise;
+    } else if (name == "hugetlb") {
+        policy = HugePagePolicy::HugeTLB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* hugepage_policy_name(HugePagePolicy policy) {
+    switch (policy) {
+        case HugePagePolicy::Off: return "off";
+        case HugePagePolicy::Madvise: return "madvise";
+        case HugePagePolicy::HugeTLB: return "hugetlb";
+    }
+    return "unknown";
+}
+
+void* large_alloc(std::size_t bytes, HugePagePolicy policy) {
+    if (!use_mapping(bytes)) {
+        return ::operator new(bytes);
+    }
+    Telemetry& t = telemetry();
+    std::size_t mapped = round_to_huge_page(bytes);
+    void* ptr = nullptr;
+
+#ifdef MAP_HUGETLB
+    if (policy == HugePagePolicy::HugeTLB) {
+        // The kernel hands out 2 MB-aligned addresses for hugetlb mappings
+        ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED) {
+            ptr = nullptr;
+            t.hugetlb_fallbacks += 1;
+        } else {
+            t.hugetlb_bytes += static_cast<long long>(mapped);
+        }
+    }
+#endif
+
+    if (ptr == nullptr) {
+        ptr = map_aligned(mapped);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (policy == HugePagePolicy::Off) {
+#ifdef MADV_NOHUGEPAGE
+            // Keep THP "always" mode from backing it anyway, so off is a clean 4 KB baseline
+            madvise(ptr, mapped, MADV_NOHUGEPAGE);
+#endif
+        } else {
+#ifdef MADV_HUGEPAGE
+            if (madvise(ptr, mapped, MADV_HUGEPAGE) == 0) {
+                t.madvise_bytes += static_cast<long long>(mapped);
+            }
+#endif
+        }
+    }
+
+    t.large_mappings += 1;
+    long long live = (t.large_mapped_bytes += static_cast<long long>(mapped));
+    update_peak(t.large_mapped_peak, live);
+    return ptr;
+}
+
+void large_free(void* ptr, std::size_t bytes) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (!use_mapping(bytes)) {
+        ::operator delete(ptr);
+        return;
+    }
+    std::size_t mapped = round_to_huge_page(bytes);
+    munmap(ptr, mapped);
+    Telemetry& t = telemetry();
+    t.large_mappings -= 1;
+    t.large_mapped_bytes -= static_cast<long long>(mapped);
+}
+
+long long anon_huge_bytes() {
+    // smaps_rollup is cheap compared to walking every mapping in smaps
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    if (!smaps) {
+        return -1;
+    }
+    std::string line;
+    while (std::getline(smaps, line)) {
+        if (line.rfind("AnonHugePages:", 0) == 0) {
+            std::istringstream fields(line.substr(14));
+            long long kb = 0;
+            fields >> kb;
+            return kb * 1024;
+        }
+    }
+    return -1;
+}
+
+void sample_hugepage_backing() {
+    long long backed = anon_huge_bytes();
+    if (backed > 0) {
+        update_peak(telemetry().anon_huge_peak, backed);
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+
+// Size of a transparent huge page on x86-64 / aarch64 (4 KB base pages)
+constexpr std::size_t kHugePageSize = std::size_t(2) << 20;
+
+/**
+ * @brief How large engine allocations (frontier tables, key arenas, split tables) are backed.
+ *
+ * Off      - 4 KB pages only (MADV_NOHUGEPAGE), the baseline for TLB comparisons.
+ * Madvise  - 2 MB-aligned anonymous mappings hinted with MADV_HUGEPAGE.
+ * HugeTLB  - MAP_HUGETLB mappings from the reserved pool, falling back to Madvise
+ *            when the pool is exhausted or not configured.
+ */
+enum class HugePagePolicy { Off, Madvise, HugeTLB };
+
+/**
+ * @brief Sets the process-wide policy used by large_alloc.
+ * @param policy The new policy. Only affects allocations made afterwards.
+ */
+void set_hugepage_policy(HugePagePolicy policy);
+
+/**
+ * @brief Returns the current process-wide huge page policy.
+ */
+HugePagePolicy get_hugepage_policy();
+
+/**
+ * @brief Parses "off", "madvise" or "hugetlb".
+ * @param name The policy name given on the command line.
+ * @param policy Receives the parsed policy on success.
+ * @return True if the name was recognised.
+ */
+bool parse_hugepage_policy(const std::string& name, HugePagePolicy& policy);
+
+/**
+ * @brief Returns the command line name of a policy.
+ */
+const char* hugepage_policy_name(HugePagePolicy policy);
+
+/**
+ * @brief Allocates a large buffer according to policy.
+ *
+ * Requests smaller than kHugePageSize go through operator new; larger ones come
+ * from a 2 MB-aligned anonymous mapping advised according to the policy.
+ * @param bytes The number of bytes to allocate.
+ * @param policy How a mapped buffer is backed.
+ * @return Pointer to the buffer. Throws std::bad_alloc on failure.
+ */
+void* large_alloc(std::size_t bytes, HugePagePolicy policy);
+
+/**
+ * @brief large_alloc with the process-wide policy.
+ */
+inline void* large_alloc(std::size_t bytes) { return large_alloc(bytes, get_hugepage_policy()); }
+
+/**
+ * @brief Releases a buffer obtained from large_alloc.
+ * @param ptr The pointer returned by large_alloc.
+ * @param bytes The size passed to large_alloc.
+ */
+void large_free(void* ptr, std::size_t bytes);
+
+/**
+ * @brief Reads the amount of anonymous memory currently backed by transparent huge pages.
+ * @return AnonHugePages of the process in bytes, or -1 if /proc is unavailable.
+ */
+long long anon_huge_bytes();
+
+/**
+ * @brief Samples anon_huge_bytes into the telemetry peak counter.
+ */
+void sample_hugepage_backing();
+
+/**
+ * @brief STL allocator routing container storage through large_alloc.
+ *
+ * Carries its policy (the process-wide one by default). large_free does not depend
+ * on the policy, so all instances compare equal; the policy follows moved and
+ * swapped containers.
+ */
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    HugePageAllocator() noexcept : policy(get_hugepage_policy()) {}
+    explicit HugePageAllocator(HugePagePolicy policy) noexcept : policy(policy) {}
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>& other) noexcept : policy(other.policy) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(large_alloc(n * sizeof(T), policy));
+    }
+    void deallocate(T* ptr, std::size_t n) noexcept {
+        large_free(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>&) const noexcept { return false; }
+
+    HugePagePolicy policy;
+};
+
+#endif // HUGEPAGE_H
@@ -1,40 +1,33 @@
 #include <iostream>
 #include "tree_utils.h"
 #include "sampler.h"
+#include "step_engine.h"
+#include "reducers.h"
+#include "approx.h"
+#include "sharded.h"
+#include "net.h" // For parse_host_port
+#include "work_queue.h"
+#include "monte_carlo.h"
+#include "tree_cache.h"
+#include "early_abort.h"
+#include "stratified.h"
+#include "tuning.h"
+#include "telemetry.h"
+#include "metrics.h"
+#include <chrono>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <sstream>
+#include <cstdio>  // For sscanf
+#include <cstdlib> // For strtoull
+#include <cstdint>
 
-int main(int argc, char *argv[]) {
+// Formats "csp,tau,t18,t14,t12": the pnode counts at which the CDF reaches 1/8, 1/4 and 1/2
+std::string threshold_line(int csp, int tau, const Histogram& hist) {
     using namespace std;
-    int csp = 100;
-    int w_grind = 0;
-    int tau = 50;
-
-    if (argc != 3) {
-        cout << "Usage: " << argv[0] << " <csp> <tau>" << endl;
-        return 1;
-    }
-    // Parse command line arguments
-
-    csp = atoi(argv[1]);
-    tau = atoi(argv[2]);
-
-    auto [t0, k0, t1, k1] = _vc_param(csp - w_grind, tau);
-    auto L = (1LL << k0) * t0 + (1LL << k1) * t1;
-    auto max_size = t0 * k0 + t1 * k1;
-
-    cerr << "L = " << L << " max_size = " << max_size << endl; 
-    auto dist = sample(L, tau);
-    auto hist = get_hist(dist);
-
-    // std::cout << "Histogram for one tree distribution grinded_csp = " << csp - w_grind << " tau = " << tau << std::endl;
-
-    // for (auto & [pnode_size, prob] : hist) {
-    //     std::cout << "Size: ";
-    //     std::cout << pnode_size << " ";
-    //     std::cout << "Probability: " << prob << std::endl;
-    // }
-
     vector<pair<int, double>> cdf(hist.begin(), hist.end());
     double prob_sum = 0.0;
     for (auto & [pnode_size, prob] : cdf) {
@@ -57,11 +50,515 @@ int main(int argc, char *argv[]) {
         [](const std::pair<int, double>& a, const std::pair<int, double>& b) {
             return a.second < b.second;
         });
-    cout << csp << "," 
+    if (rej_1_2_bound == cdf.end()) {
+        // Empty, or too little mass to reach the median (e.g. no samples)
+        throw std::runtime_error("Histogram has no mass to take thresholds from");
+    }
+    std::ostringstream line;
+    line << csp << "," 
          << tau << "," 
          << rej_1_8_bound->first << "," 
          << rej_1_4_bound->first << "," 
-         << rej_1_2_bound->first << std::endl;
+         << rej_1_2_bound->first;
+    return line.str();
+}
+
+// Runs the exact and the approximate engine and prints one CSV line comparing them
+int validate_approximation(int csp, int tau, int L, const EngineOptions& options) {
+    using namespace std;
+    using namespace std::chrono;
+    EngineOptions exact_options = options;
+    exact_options.approx_cutoff = 0;
+
+    auto exact_start = steady_clock::now();
+    PnodeHistogram exact;
+    sample_reduce(L, tau, exact, exact_options);
+    double exact_ms = duration<double, milli>(steady_clock::now() - exact_start).count();
+    long long exact_peak = telemetry().frontier_peak;
+
+    auto approx_start = steady_clock::now();
+    PnodeHistogram approx;
+    sample_reduce(L, tau, approx, options);
+    double approx_ms = duration<double, milli>(steady_clock::now() - approx_start).count();
+    long long approx_peak = telemetry().frontier_peak;
+
+    cout << "csp,tau,cutoff,tv_distance,exact_ms,approx_ms,exact_frontier_peak,approx_frontier_peak" << endl;
+    cout << csp << "," << tau << "," << options.approx_cutoff << ","
+         << total_variation(exact.result(), approx.result()) << ","
+         << exact_ms << "," << approx_ms << ","
+         << exact_peak << "," << approx_peak << endl;
+    return 0;
+}
+
+// Runs the in-process and the sharded engine and prints one CSV line comparing them
+int validate_sharding(int csp, int tau, int L, const ShardOptions& shard_options, const EngineOptions& options) {
+    using namespace std;
+    using namespace std::chrono;
+
+    auto local_start = steady_clock::now();
+    PnodeHistogram local;
+    sample_reduce(L, tau, local, options);
+    double local_ms = duration<double, milli>(steady_clock::now() - local_start).count();
+
+    auto sharded_start = steady_clock::now();
+    Histogram sharded = sample_sharded(L, tau, shard_options, options);
+    double sharded_ms = duration<double, milli>(steady_clock::now() - sharded_start).count();
+
+    cout << "csp,tau,shards,tv_distance,local_ms,sharded_ms" << endl;
+    cout << csp << "," << tau << "," << shard_options.shards << ","
+         << total_variation(local.result(), sharded) << ","
+         << local_ms << "," << sharded_ms << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    using namespace std;
+    int csp = 100;
+    int w_grind = 0;
+    int tau = 50;
+
+    // Remote shard worker: my_app --worker HOST:PORT
+    if (argc == 3 && string(argv[1]) == "--worker") {
+        string host;
+        int port = 0;
+        if (!parse_host_port(argv[2], host, port)) {
+            cerr << "Bad coordinator address: " << argv[2] << endl;
+            return 1;
+        }
+        try {
+            run_shard_worker(host, port);
+        } catch (const std::exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Sweep worker: my_app --queue-worker DIR [options], takes points from a batch_run.py queue
+    string queue_dir;
+    if (argc >= 3 && string(argv[1]) == "--queue-worker") {
+        queue_dir = argv[2];
+    }
+
+    if (argc < 3) {
+        cout << "Usage: " << argv[0] << " <csp> <tau> [options]" << endl;
+        cout << "       " << argv[0] << " --worker HOST:PORT   (shard worker for a coordinator started with --no-spawn)" << endl;
+        cout << "       " << argv[0] << " --queue-worker DIR [options]   (runs sweep points published by batch_run.py --queue-dir)" << endl;
+        cout << "Options:" << endl;
+        cout << "  --hugepages off|madvise|hugetlb   Backing of large engine tables (default madvise)" << endl;
+        cout << "  --batch N                         Frontier inserts prefetched per group (default 32, 1 = off)" << endl;
+        cout << "  --max-load P                      Grow frontier tables beyond P% load (default 50)" << endl;
+        cout << "  --arena-kb N                      Key arena block size in KB (default 8192)" << endl;
+        cout << "  --autotune                        Time the engine knobs on this L and save the fastest for this machine" << endl;
+        cout << "  --tune-file PATH                  Tuning file (default $OTS_TUNING_FILE or ~/.cache/ots_sampler/tuning.tsv)" << endl;
+        cout << "  --no-tune                         Do not load the saved tuning of this machine" << endl;
+        cout << "  --fuse2                           Advance two picks per pass (skips every other frontier)" << endl;
+        cout << "  --no-fuse2                        One pick per pass, even if --autotune chose --fuse2" << endl;
+        cout << "  --approx-cutoff N                 Merge configs that differ only in subtrees below N leaves" << endl;
+        cout << "  --validate-approx                 Run exact and --approx-cutoff, report TV distance of the histograms" << endl;
+        cout << "  --compress-frontier               Keep the frontier as delta-encoded sorted blocks (less RAM, more CPU)" << endl;
+        cout << "  --pipeline E:A                    Expand on E threads feeding A aggregator threads through lock-free queues (final pick on all E+A)" << endl;
+        cout << "  --checkpoint PATH                 Checkpoint each step's frontier to PATH (written asynchronously)" << endl;
+        cout << "  --resume PATH                     Continue from a checkpoint written by --checkpoint" << endl;
+        cout << "  --shards N                        Hold the frontier in N worker processes connected over TCP" << endl;
+        cout << "  --listen HOST:PORT                Coordinator address for --shards (default 127.0.0.1, free port)" << endl;
+        cout << "  --no-spawn                        Do not start local workers; wait for --worker processes" << endl;
+        cout << "  --validate-shards                 Run in-process and with --shards, report TV distance of the histograms" << endl;
+        cout << "  --monte-carlo N                   Estimate by sampling: N challenges per RNG stream (see mc_merge)" << endl;
+        cout << "  --streams A:B                     Monte Carlo RNG streams A..B-1 (default 0:64); disjoint per machine" << endl;
+        cout << "  --seed S                          Monte Carlo seed (default 1)" << endl;
+        cout << "  --mc-out FILE                     Write the Monte Carlo tally to FILE for mc_merge" << endl;
+        cout << "  --threads N                       Monte Carlo sampling threads (default 1)" << endl;
+        cout << "  --tree-cache N                    Signer cache depth vs. PRG expansions per opening, over N challenges" << endl;
+        cout << "  --stratified N                    Estimate with N samples stratified over the first picks" << endl;
+        cout << "  --strata-picks K                  Picks enumerated exactly to form the strata (default 6)" << endl;
+        cout << "  --points random|lattice           Uniforms for the remaining picks (default random)" << endl;
+        cout << "  --compare-variance R              Variance of plain, stratified and lattice estimates over R replicates" << endl;
+        cout << "  --early-abort N                   Signing work per T_open with and without early abort, over N challenges" << endl;
+        cout << "  --abort-threshold T               With --early-abort: the work distribution at T_open = T instead" << endl;
+        cout << "  --time-limit S                    Stop after S seconds; if not done, exit with status 2 and print the last finished step to stderr" << endl;
+        cout << "  --metrics-file PATH               Rewrite Prometheus textfile metrics to PATH while running" << endl;
+        cout << "  --metrics-interval S              Seconds between --metrics-file rewrites (default 15)" << endl;
+        cout << "  --lease-seconds N                 --queue-worker lease timeout (default 300)" << endl;
+        cout << "  --projection NAME                 pnodes (thresholds, default), largest, heights or joint (pnodes,bytes)" << endl;
+        return 1;
+    }
+    // Parse command line arguments
+
+    if (queue_dir.empty()) {
+        csp = atoi(argv[1]);
+        tau = atoi(argv[2]);
+    }
+
+    EngineOptions options;
+    // Knobs measured by --autotune on this machine; explicit flags below override them
+    string tune_file = default_tuning_path();
+    bool load_tune = true;
+    for (int i = 3; i < argc; ++i) {
+        if (string(argv[i]) == "--no-tune") {
+            load_tune = false;
+        } else if (string(argv[i]) == "--tune-file" && i + 1 < argc) {
+            tune_file = argv[i + 1];
+        }
+    }
+    MachineKey machine = MachineKey::current();
+    if (load_tune && load_tuning(tune_file, machine, options)) {
+        cerr << "Engine tuning for " << machine.host << " (" << machine.cpu << "): " << format_tuning(options) << endl;
+    }
+    bool explicit_fuse2 = false; // --fuse2 given on the command line rather than by the tuning file
+    bool explicit_pipeline = false; // Likewise for --pipeline
+    bool autotune_mode = false;
+    string projection = "pnodes";
+    bool validate_approx = false;
+    ShardOptions shard_options;
+    bool sharded = false;
+    bool validate_shards = false;
+    QueueOptions queue_options;
+    McParams mc_params;
+    mc_params.seed = 1;
+    std::uint64_t stream_begin = 0;
+    std::uint64_t stream_end = 64;
+    string mc_out;
+    int threads = 1;
+    std::uint64_t tree_cache_samples = 0;
+    std::uint64_t early_abort_samples = 0;
+    int abort_threshold = -1;
+    std::uint64_t stratified_samples = 0;
+    StratifiedOptions stratified_options;
+    int variance_replicates = 0;
+    string metrics_file;
+    double metrics_interval = 15;
+    double time_limit = 0;
+    for (int i = 3; i < argc; ++i) {
+        string flag = argv[i];
+        if (flag == "--hugepages" && i + 1 < argc) {
+            if (!parse_hugepage_policy(argv[++i], options.hugepages)) {
+                cerr << "Unknown huge page policy: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (flag == "--batch" && i + 1 < argc) {
+            options.insert_batch = max(1, atoi(argv[++i]));
+        } else if (flag == "--max-load" && i + 1 < argc) {
+            options.max_load_percent = min(90, max(10, atoi(argv[++i])));
+        } else if (flag == "--arena-kb" && i + 1 < argc) {
+            options.arena_block_bytes = static_cast<std::size_t>(max(4, atoi(argv[++i]))) * 1024;
+        } else if (flag == "--autotune") {
+            autotune_mode = true;
+        } else if (flag == "--no-tune") {
+            // Handled before parsing
+        } else if (flag == "--tune-file" && i + 1 < argc) {
+            ++i; // Handled before parsing
+        } else if (flag == "--fuse2") {
+            options.fuse_two_picks = true;
+            explicit_fuse2 = true;
+        } else if (flag == "--no-fuse2") {
+            options.fuse_two_picks = false;
+            explicit_fuse2 = false;
+        } else if (flag == "--approx-cutoff" && i + 1 < argc) {
+            options.approx_cutoff = max(0, atoi(argv[++i]));
+        } else if (flag == "--validate-approx") {
+            validate_approx = true;
+        } else if (flag == "--compress-frontier") {
+            options.compress_frontier = true;
+        } else if (flag == "--pipeline" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d:%d", &options.pipeline_expanders, &options.pipeline_aggregators) != 2
+                || options.pipeline_expanders < 1 || options.pipeline_aggregators < 1) {
+                cerr << "Bad pipeline split: " << argv[i] << endl;
+                return 1;
+            }
+            explicit_pipeline = true;
+        } else if (flag == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint_path = argv[++i];
+        } else if (flag == "--resume" && i + 1 < argc) {
+            options.resume_path = argv[++i];
+        } else if (flag == "--shards" && i + 1 < argc) {
+            shard_options.shards = max(1, atoi(argv[++i]));
+            sharded = true;
+        } else if (flag == "--listen" && i + 1 < argc) {
+            if (!parse_host_port(argv[++i], shard_options.listen_host, shard_options.listen_port)) {
+                cerr << "Bad listen address: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (flag == "--no-spawn") {
+            shard_options.spawn_workers = false;
+        } else if (flag == "--validate-shards") {
+            validate_shards = true;
+        } else if (flag == "--monte-carlo" && i + 1 < argc) {
+            mc_params.samples_per_stream = strtoull(argv[++i], nullptr, 10);
+        } else if (flag == "--streams" && i + 1 < argc) {
+            unsigned long long begin = 0, end = 0;
+            if (sscanf(argv[++i], "%llu:%llu", &begin, &end) != 2 || end <= begin) {
+                cerr << "Bad stream range: " << argv[i] << endl;
+                return 1;
+            }
+            stream_begin = begin;
+            stream_end = end;
+        } else if (flag == "--seed" && i + 1 < argc) {
+            mc_params.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (flag == "--mc-out" && i + 1 < argc) {
+            mc_out = argv[++i];
+        } else if (flag == "--tree-cache" && i + 1 < argc) {
+            tree_cache_samples = strtoull(argv[++i], nullptr, 10);
+        } else if (flag == "--stratified" && i + 1 < argc) {
+            stratified_samples = strtoull(argv[++i], nullptr, 10);
+        } else if (flag == "--strata-picks" && i + 1 < argc) {
+            stratified_options.strata_picks = max(0, atoi(argv[++i]));
+        } else if (flag == "--points" && i + 1 < argc) {
+            if (!parse_point_set(argv[++i], stratified_options.points)) {
+                cerr << "Unknown point set: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (flag == "--compare-variance" && i + 1 < argc) {
+            variance_replicates = max(2, atoi(argv[++i]));
+        } else if (flag == "--early-abort" && i + 1 < argc) {
+            early_abort_samples = strtoull(argv[++i], nullptr, 10);
+        } else if (flag == "--abort-threshold" && i + 1 < argc) {
+            abort_threshold = max(0, atoi(argv[++i]));
+        } else if (flag == "--threads" && i + 1 < argc) {
+            threads = max(1, atoi(argv[++i]));
+        } else if (flag == "--time-limit" && i + 1 < argc) {
+            time_limit = atof(argv[++i]);
+        } else if (flag == "--metrics-file" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (flag == "--metrics-interval" && i + 1 < argc) {
+            metrics_interval = atof(argv[++i]);
+        } else if (flag == "--lease-seconds" && i + 1 < argc) {
+            queue_options.lease_seconds = max(1, atoi(argv[++i]));
+        } else if (flag == "--projection" && i + 1 < argc) {
+            projection = argv[++i];
+        } else {
+            cerr << "Unknown option: " << flag << endl;
+            return 1;
+        }
+    }
+
+    if (time_limit > 0 && (sharded || validate_shards || validate_approx || projection != "pnodes"
+                           || mc_params.samples_per_stream > 0 || stratified_samples > 0 || !queue_dir.empty())) {
+        cerr << "--time-limit only supports the in-process pnodes run" << endl;
+        return 1;
+    }
+    if (sharded && (projection != "pnodes" || validate_approx)) {
+        cerr << "--shards only supports the pnodes projection" << endl;
+        return 1;
+    }
+    if (options.pipeline_expanders > 0 && !explicit_pipeline
+        && (explicit_fuse2 || options.approx_cutoff > 0 || options.compress_frontier || sharded || validate_shards)) {
+        // Same rule as for fuse2 below: a tuned knob gives way to the modes the flags ask for
+        cerr << "Ignoring tuned pipeline=" << options.pipeline_expanders << ":" << options.pipeline_aggregators
+             << ": not combinable with the requested mode" << endl;
+        options.pipeline_expanders = 0;
+        options.pipeline_aggregators = 0;
+    }
+    if (options.pipeline_expanders > 0 && (sharded || validate_shards)) {
+        cerr << "--pipeline is not supported with --shards" << endl;
+        return 1;
+    }
+    if (options.pipeline_expanders > 0 && options.fuse_two_picks && !explicit_fuse2) {
+        // The tuning file only picks the fastest knobs; it must not turn on a mode the flags rule out
+        cerr << "Ignoring tuned fuse2=1: --pipeline runs single picks" << endl;
+        options.fuse_two_picks = false;
+    }
+    if (mc_params.samples_per_stream > 0 && (projection != "pnodes" || validate_approx || validate_shards)) {
+        cerr << "--monte-carlo only supports the pnodes projection" << endl;
+        return 1;
+    }
+
+    if ((stratified_samples > 0 || variance_replicates > 0) && (projection != "pnodes" || validate_approx || validate_shards)) {
+        cerr << "--stratified only supports the pnodes projection" << endl;
+        return 1;
+    }
+    stratified_options.seed = mc_params.seed;
+    stratified_options.threads = threads;
+
+    std::unique_ptr<MetricsWriter> metrics;
+    if (!metrics_file.empty()) {
+        try {
+            string labels = queue_dir.empty() ? "csp=\"" + to_string(csp) + "\",tau=\"" + to_string(tau) + "\"" : "";
+            metrics = std::make_unique<MetricsWriter>(metrics_file, metrics_interval, labels);
+        } catch (const std::exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    if (!queue_dir.empty()) {
+        auto run_point = [&](const SweepPoint& point) {
+            auto [t0, k0, t1, k1] = _vc_param(point.csp - point.w_grind, point.tau);
+            int L = static_cast<int>((1LL << k0) * t0 + (1LL << k1) * t1);
+            reset_telemetry();
+            if (metrics) {
+                metrics->set_labels("csp=\"" + to_string(point.csp) + "\",tau=\"" + to_string(point.tau) + "\"");
+            }
+            Histogram hist;
+            if (sharded) {
+                hist = sample_sharded(L, point.tau, shard_options, options);
+            } else {
+                PnodeHistogram pnodes;
+                sample_reduce(L, point.tau, pnodes, options);
+                hist = pnodes.result();
+            }
+            return threshold_line(point.csp, point.tau, hist);
+        };
+        try {
+            int finished = run_queue_worker(queue_dir, queue_options, run_point);
+            cerr << "Queue worker finished " << finished << " points" << endl;
+        } catch (const std::exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    auto [t0, k0, t1, k1] = _vc_param(csp - w_grind, tau);
+    auto L = (1LL << k0) * t0 + (1LL << k1) * t1;
+    auto max_size = t0 * k0 + t1 * k1;
+
+    cerr << "L = " << L << " max_size = " << max_size << endl; 
+    Histogram hist;
+    try {
+        if (autotune_mode) {
+            vector<TuneTrial> trials;
+            EngineOptions tuned = autotune(L, tau, options, trials);
+            cout << "seconds,settings" << endl;
+            for (const TuneTrial& trial : trials) {
+                cout << trial.seconds << "," << format_tuning(trial.options) << endl;
+            }
+            save_tuning(tune_file, machine, tuned);
+            cerr << "Saved " << format_tuning(tuned) << " for " << machine.host << " (" << machine.cpu
+                 << ") to " << tune_file << endl;
+            return 0;
+        } else if (tree_cache_samples > 0) {
+            // One csp-bit seed per cached node
+            auto rows = simulate_tree_cache(L, tau, (csp + 7) / 8, tree_cache_samples, mc_params.seed, threads);
+            cout << "cache_depth,cached_nodes,memory_bytes,mean_expansions,p50,p99,max,pareto" << endl;
+            for (const CacheTradeoff& row : rows) {
+                cout << row.cache_depth << "," << row.cached_nodes << "," << row.memory_bytes << ","
+                     << row.mean_expansions << "," << row.p50 << "," << row.p99 << "," << row.max << ","
+                     << (row.pareto ? 1 : 0) << endl;
+            }
+            return 0;
+        } else if (early_abort_samples > 0 && abort_threshold >= 0) {
+            auto outcomes = early_abort_distribution(L, tau, abort_threshold, early_abort_samples, mc_params.seed, threads);
+            cout << "outcome,leaves_processed,nodes_emitted,probability" << endl;
+            for (const AbortOutcome& outcome : outcomes) {
+                cout << (outcome.accepted ? "accept" : "abort") << "," << outcome.leaves << "," << outcome.nodes << ","
+                     << outcome.prob << endl;
+            }
+            return 0;
+        } else if (early_abort_samples > 0) {
+            auto rows = simulate_early_abort(L, tau, early_abort_samples, mc_params.seed, threads);
+            cout << "t_open,accept_prob,attempts,rejected_leaves,accepted_nodes,"
+                    "leaves_abort,nodes_abort,leaves_full,nodes_full" << endl;
+            for (const AbortSummary& row : rows) {
+                cout << row.threshold << "," << row.accept_prob << "," << row.expected_attempts << ","
+                     << row.rejected_leaves << "," << row.accepted_nodes << "," << row.total_leaves << ","
+                     << row.total_nodes << "," << row.full_leaves << "," << row.full_nodes << endl;
+            }
+            return 0;
+        } else if (variance_replicates > 0) {
+            std::uint64_t samples = stratified_samples > 0 ? stratified_samples : 100000;
+            vector<int> probes;
+            auto reports = compare_variance(L, tau, samples, variance_replicates, stratified_options, probes);
+            cout << "method,samples,seconds";
+            for (const char* name : {"t18", "t14", "t12"}) {
+                cout << ",var_" << name;
+            }
+            for (const char* name : {"t18", "t14", "t12"}) {
+                cout << ",gain_" << name;
+            }
+            cout << endl;
+            for (const VarianceReport& report : reports) {
+                cout << report.method << "," << report.samples << "," << report.seconds;
+                for (double variance : report.variance) {
+                    cout << "," << variance;
+                }
+                for (double reduction : report.reduction) {
+                    cout << "," << reduction;
+                }
+                cout << endl;
+            }
+            return 0;
+        } else if (validate_shards) {
+            return validate_sharding(csp, tau, L, shard_options, options);
+        } else if (validate_approx) {
+            return validate_approximation(csp, tau, L, options);
+        } else if (projection == "largest") {
+            ProjectionHistogram<LargestSubtree> largest;
+            sample_reduce(L, tau, largest, options);
+            for (auto& [subtree_size, prob] : largest.result()) {
+                cout << subtree_size << "," << prob << endl;
+            }
+            return 0;
+        } else if (projection == "heights") {
+            HeightProfile heights;
+            sample_reduce(L, tau, heights, options);
+            for (auto& [height, expected] : heights.result()) {
+                cout << height << "," << expected << endl;
+            }
+            return 0;
+        } else if (projection == "joint") {
+            // One csp-bit seed per revealed node
+            JointHistogram<PnodeCount, OpeningBytes> joint(PnodeCount(), OpeningBytes{(csp + 7) / 8, 0});
+            sample_reduce(L, tau, joint, options);
+            for (auto& [values, prob] : joint.result()) {
+                cout << values.first << "," << values.second << "," << prob << endl;
+            }
+            return 0;
+        } else if (projection != "pnodes") {
+            cerr << "Unknown projection: " << projection << endl;
+            return 1;
+        }
+        if (stratified_samples > 0) {
+            StratifiedResult result = sample_stratified(L, tau, stratified_samples, stratified_options);
+            cerr << "Stratified: " << result.samples << " samples over " << result.strata << " strata" << endl;
+            hist = result.histogram;
+        } else if (mc_params.samples_per_stream > 0) {
+            mc_params.csp = csp;
+            mc_params.tau = tau;
+            mc_params.w_grind = w_grind;
+            mc_params.num_leaf = L;
+            McResult result = sample_monte_carlo(mc_params, stream_begin, stream_end, threads);
+            cerr << "Monte Carlo: " << result.samples << " samples from streams "
+                 << stream_begin << ".." << stream_end << " (seed " << mc_params.seed << ")" << endl;
+            if (!mc_out.empty()) {
+                write_mc_result(mc_out, result);
+            }
+            hist = result.histogram();
+        } else if (sharded) {
+            hist = sample_sharded(L, tau, shard_options, options);
+        } else if (time_limit > 0) {
+            SampleControl control;
+            control.deadline = std::chrono::steady_clock::now()
+                             + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(time_limit));
+            PartialHistogram partial = get_hist_randonetree(csp - w_grind, tau, control, options);
+            if (!partial.complete) {
+                // Not a tau-pick result: keep it off stdout, where sweeps read results
+                cerr << "Time limit reached: histogram after " << partial.steps_done << " of " << tau << " picks" << endl;
+                if (!partial.histogram.empty()) {
+                    cerr << "Partial thresholds: " << threshold_line(csp, partial.steps_done, partial.histogram) << endl;
+                }
+                return 2;
+            }
+            hist = partial.histogram;
+        } else {
+            PnodeHistogram pnodes;
+            sample_reduce(L, tau, pnodes, options);
+            hist = pnodes.result();
+        }
+        cout << threshold_line(csp, tau, hist) << std::endl;
+    } catch (const std::exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    // std::cout << "Histogram for one tree distribution grinded_csp = " << csp - w_grind << " tau = " << tau << std::endl;
+
+    // for (auto & [pnode_size, prob] : hist) {
+    //     std::cout << "Size: ";
+    //     std::cout << pnode_size << " ";
+    //     std::cout << "Probability: " << prob << std::endl;
+    // }
 
     return 0;
 }
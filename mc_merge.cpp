@@ -0,0 +1,61 @@
+// Merges Monte Carlo result files written by `my_app ... --monte-carlo N --mc-out FILE`.
+//
+// Files must come from the same csp/tau/w_grind/seed/samples-per-stream and cover
+// disjoint stream ranges; anything else is rejected rather than double counted.
+// Prints the merged thresholds with 95% confidence intervals as one CSV line.
+
+#include "monte_carlo.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    std::string out_path;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        std::cout << "Usage: " << argv[0] << " [-o merged.bin] result.bin..." << std::endl;
+        return 1;
+    }
+
+    try {
+        McResult merged = read_mc_result(inputs[0]);
+        for (std::size_t i = 1; i < inputs.size(); ++i) {
+            McResult next = read_mc_result(inputs[i]);
+            try {
+                merge_mc_result(merged, next);
+            } catch (const std::invalid_argument& e) {
+                throw std::invalid_argument(inputs[i] + ": " + e.what());
+            }
+        }
+        if (!out_path.empty()) {
+            write_mc_result(out_path, merged);
+        }
+
+        std::cerr << "Merged " << inputs.size() << " files: " << merged.samples << " samples, streams";
+        for (const auto& [begin, end] : merged.streams) {
+            std::cerr << " " << begin << ".." << end;
+        }
+        std::cerr << std::endl;
+
+        std::cout << "csp,tau,samples,t18,t18_lo,t18_hi,t14,t14_lo,t14_hi,t12,t12_lo,t12_hi" << std::endl;
+        std::cout << merged.params.csp << "," << merged.params.tau << "," << merged.samples;
+        for (double p : {0.125, 0.25, 0.5}) {
+            QuantileEstimate q = tally_quantile(merged, p);
+            std::cout << "," << q.value << "," << q.lower << "," << q.upper;
+        }
+        std::cout << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
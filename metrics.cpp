@@ -0,0 +1,189 @@
+#include "metrics.h"
+#include "telemetry.h"
+
+#include <cerrno>
+#include <cstdio> // For std::rename, std::remove
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/resource.h> // For getrusage
+#include <unistd.h>
+
+namespace {
+
+// Resident set size from /proc/self/statm, 0 if unavailable
+long long current_rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    long long pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) {
+        return 0;
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Writes samples in the Prometheus text exposition format
+class Exposition {
+public:
+    explicit Exposition(const std::string& labels) : labels_(labels) {}
+
+    template <typename T>
+    void gauge(const char* name, const char* help, T value) {
+        header(name, help, "gauge");
+        out_ << name << braces("") << ' ' << value << '\n';
+    }
+
+    template <typename T>
+    void counter(const char* name, const char* help, T value) {
+        header(name, help, "counter");
+        out_ << name << braces("") << ' ' << value << '\n';
+    }
+
+    // counts[i] is the number of observations in bucket i (not cumulative)
+    void histogram(const char* name, const char* help, const double* bounds, const long long* counts,
+                   int buckets, double sum) {
+        header(name, help, "histogram");
+        long long cumulative = 0;
+        for (int i = 0; i < buckets; ++i) {
+            cumulative += counts[i];
+            std::ostringstream le;
+            if (i + 1 < buckets) {
+                le << "le=\"" << bounds[i] << "\"";
+            } else {
+                le << "le=\"+Inf\"";
+            }
+            out_ << name << "_bucket" << braces(le.str()) << ' ' << cumulative << '\n';
+        }
+        out_ << name << "_sum" << braces("") << ' ' << sum << '\n';
+        out_ << name << "_count" << braces("") << ' ' << cumulative << '\n';
+    }
+
+    std::string str() const { return out_.str(); }
+
+private:
+    void header(const char* name, const char* help, const char* type) {
+        out_ << "# HELP " << name << ' ' << help << '\n';
+        out_ << "# TYPE " << name << ' ' << type << '\n';
+    }
+
+    std::string braces(const std::string& extra) const {
+        if (labels_.empty() && extra.empty()) return "";
+        if (labels_.empty()) return "{" + extra + "}";
+        if (extra.empty()) return "{" + labels_ + "}";
+        return "{" + labels_ + "," + extra + "}";
+    }
+
+    const std::string& labels_;
+    std::ostringstream out_;
+};
+
+} // namespace
+
+MetricsWriter::MetricsWriter(std::string path, double interval_seconds, std::string labels)
+    : path_(std::move(path)), interval_(interval_seconds), start_(std::chrono::steady_clock::now()),
+      labels_(std::move(labels)), last_write_(start_) {
+    if (interval_seconds <= 0) {
+        throw std::invalid_argument("Metrics interval must be positive");
+    }
+    last_transitions_ = telemetry().transitions;
+    if (!write()) {
+        throw std::runtime_error("Cannot write metrics file " + path_ + ": " + std::strerror(errno));
+    }
+    thread_ = std::thread(&MetricsWriter::run, this);
+}
+
+MetricsWriter::~MetricsWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    write(); // Final values, e.g. for runs shorter than the interval
+}
+
+void MetricsWriter::set_labels(std::string labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    labels_ = std::move(labels);
+}
+
+void MetricsWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, interval_, [&] { return stop_; })) {
+        lock.unlock();
+        bool ok = write();
+        lock.lock();
+        if (!ok && !reported_error_) {
+            std::cerr << "Cannot write metrics file " << path_ << ": " << std::strerror(errno) << std::endl;
+            reported_error_ = true; // Keep retrying quietly; the run itself is unaffected
+        }
+    }
+}
+
+bool MetricsWriter::write() {
+    using namespace std::chrono;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Telemetry& t = telemetry();
+
+    // Rate over the time since the previous write; reset_telemetry() between runs restarts it
+    auto now = steady_clock::now();
+    long long transitions = t.transitions;
+    double elapsed = duration<double>(now - last_write_).count();
+    double rate = elapsed > 0 && transitions >= last_transitions_ ? (transitions - last_transitions_) / elapsed : 0;
+    last_transitions_ = transitions;
+    last_write_ = now;
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    long long latency_counts[kStepLatencyBuckets];
+    for (int i = 0; i < kStepLatencyBuckets; ++i) {
+        latency_counts[i] = t.step_latency_counts[i];
+    }
+
+    Exposition out(labels_);
+    out.gauge("ots_current_step", "Picks applied so far.", t.current_step.load());
+    out.gauge("ots_total_steps", "Picks the current run applies.", t.total_steps.load());
+    out.gauge("ots_frontier_configs", "Configs in the frontier of the current step.", t.frontier_size.load());
+    out.gauge("ots_frontier_peak_configs", "Largest frontier seen.", t.frontier_peak.load());
+    out.gauge("ots_frontier_peak_bytes", "Peak bytes of the current and next frontier.", t.frontier_bytes_peak.load());
+    out.counter("ots_transitions_total", "Inserts into a next frontier.", t.transitions.load());
+    out.gauge("ots_transitions_per_second", "Transitions per second since the previous write.", rate);
+    out.gauge("ots_resident_memory_bytes", "Resident set size.", current_rss_bytes());
+    out.gauge("ots_peak_resident_memory_bytes", "Peak resident set size.", usage.ru_maxrss * 1024LL);
+    out.counter("ots_checkpoints_total", "Checkpoints committed.", t.checkpoints.load());
+    out.counter("ots_checkpoint_bytes_written_total", "Frontier bytes spilled to checkpoint files.",
+                t.io_bytes_written.load());
+    out.counter("ots_checkpoint_stall_seconds_total", "Time the step loop waited on checkpoint I/O.",
+                t.io_stall_ns / 1e9);
+    out.counter("ots_network_bytes_sent_total", "Bytes sent to other shards.", t.net_bytes_sent.load());
+    out.counter("ots_pipeline_batches_total", "Transition batches taken by pipeline aggregators.",
+                t.pipeline_batches.load());
+    out.counter("ots_pipeline_queued_batches_total", "Sum of the lane fill seen by aggregators at each take.",
+                t.pipeline_queued_batches.load());
+    out.counter("ots_pipeline_expander_waits_total", "Times a pipeline expander waited for an empty batch.",
+                t.pipeline_expander_waits.load());
+    out.counter("ots_pipeline_aggregator_waits_total", "Times a pipeline aggregator found all lanes empty.",
+                t.pipeline_aggregator_waits.load());
+    out.histogram("ots_step_duration_seconds", "Wall time of engine passes.", kStepLatencyBounds, latency_counts,
+                  kStepLatencyBuckets, t.step_ns / 1e9);
+    out.gauge("ots_uptime_seconds", "Time since the metrics writer started.", duration<double>(now - start_).count());
+    out.gauge("ots_last_update_timestamp_seconds", "Unix time of this write.",
+              duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+
+    std::string tmp = path_ + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        file << out.str();
+        if (!file.flush()) {
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        int saved = errno;
+        std::remove(tmp.c_str());
+        errno = saved;
+        return false;
+    }
+    return true;
+}
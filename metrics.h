@@ -0,0 +1,61 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Periodically rewrites a Prometheus textfile with the process telemetry.
+ *
+ * The file (e.g. for node_exporter's textfile collector) holds the current step,
+ * frontier size, transitions, transitions per second over the last interval, RSS,
+ * bytes spilled to checkpoints and sockets, and a histogram of step latencies. It is
+ * written to a temporary file in the same directory and renamed, so scrapers never
+ * see a partial file. A background thread rewrites it every interval; the destructor
+ * writes it one last time.
+ */
+class MetricsWriter {
+public:
+    /**
+     * @param path File to rewrite; should end in .prom for the textfile collector.
+     * @param interval_seconds Time between rewrites.
+     * @param labels Prometheus labels added to every sample, e.g. csp="128",tau="12" (may be empty).
+     * Throws std::runtime_error if the first write fails.
+     */
+    MetricsWriter(std::string path, double interval_seconds, std::string labels);
+    ~MetricsWriter();
+
+    MetricsWriter(const MetricsWriter&) = delete;
+    MetricsWriter& operator=(const MetricsWriter&) = delete;
+
+    /**
+     * @brief Replaces the labels, e.g. when a sweep worker moves to the next point.
+     */
+    void set_labels(std::string labels);
+
+    /**
+     * @brief Rewrites the file now. Returns false on I/O errors.
+     */
+    bool write();
+
+private:
+    void run();
+
+    std::string path_;
+    std::chrono::duration<double> interval_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::mutex mutex_; // Guards everything below and serializes writes
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::string labels_;
+    long long last_transitions_ = 0;
+    std::chrono::steady_clock::time_point last_write_;
+    bool reported_error_ = false;
+    std::thread thread_;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,267 @@
+#include "monte_carlo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio> // For std::rename
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+constexpr char kMagic[8] = {'O', 'T', 'S', 'M', 'C', 'R', 'S', '1'};
+
+// GCC/Clang builtin; __extension__ keeps -Wpedantic quiet about it
+__extension__ typedef unsigned __int128 uint128;
+
+// Tallies the streams [begin, end) into counts indexed by the number of revealed nodes
+void sample_streams(const McParams& params, std::uint64_t begin, std::uint64_t end,
+                    std::vector<std::uint64_t>& counts) {
+    long long num_leaf = params.num_leaf;
+    int tau = params.tau;
+    std::vector<long long> leaves;
+    for (std::uint64_t stream = begin; stream < end; ++stream) {
+        ChallengeStream challenges(params.seed, stream, num_leaf, tau);
+        for (std::uint64_t sample = 0; sample < params.samples_per_stream; ++sample) {
+            challenges.next(leaves);
+            std::size_t pnodes = static_cast<std::size_t>(count_copath_nodes(leaves, num_leaf));
+            if (pnodes >= counts.size()) {
+                counts.resize(pnodes + 1, 0);
+            }
+            ++counts[pnodes];
+        }
+    }
+}
+
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_pod(std::ifstream& in, const std::string& path) {
+    T value;
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error("Truncated Monte Carlo result " + path);
+    }
+    return value;
+}
+
+} // namespace
+
+ChallengeStream::ChallengeStream(std::uint64_t seed, std::uint64_t stream, long long num_leaf, int tau)
+    : num_leaf_(num_leaf), tau_(static_cast<int>(std::min<long long>(tau, num_leaf))) {
+    std::uint64_t state = seed;
+    std::uint64_t mixed = splitmix64(state) ^ stream;
+    for (std::uint64_t& word : s_) {
+        word = splitmix64(mixed);
+    }
+}
+
+void ChallengeStream::next(std::vector<long long>& leaves) {
+    // Floyd's algorithm: tau distinct leaves out of num_leaf without a bitmap
+    leaves.clear();
+    for (long long j = num_leaf_ - tau_; j < num_leaf_; ++j) {
+        long long pick = static_cast<long long>(below(static_cast<std::uint64_t>(j) + 1));
+        long long leaf = num_leaf_ + pick; // Heap index
+        if (std::find(leaves.begin(), leaves.end(), leaf) != leaves.end()) {
+            leaf = num_leaf_ + j;
+        }
+        leaves.push_back(leaf);
+    }
+}
+
+std::uint64_t ChallengeStream::next_word() {
+    std::uint64_t result = rotl(s_[1] * 5, 7) * 9;
+    std::uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+}
+
+std::uint64_t ChallengeStream::below(std::uint64_t bound) {
+    // Lemire's multiply-and-reject
+    uint128 product = static_cast<uint128>(next_word()) * bound;
+    std::uint64_t low = static_cast<std::uint64_t>(product);
+    if (low < bound) {
+        std::uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            product = static_cast<uint128>(next_word()) * bound;
+            low = static_cast<std::uint64_t>(product);
+        }
+    }
+    return static_cast<std::uint64_t>(product >> 64);
+}
+
+Histogram McResult::histogram() const {
+    Histogram hist;
+    if (samples == 0) {
+        return hist;
+    }
+    for (const auto& [pnodes, count] : tally) {
+        hist.push_back({pnodes, static_cast<double>(count) / static_cast<double>(samples)});
+    }
+    return hist;
+}
+
+McResult sample_monte_carlo(const McParams& params, std::uint64_t stream_begin, std::uint64_t stream_end,
+                            int threads) {
+    if (params.num_leaf <= 0 || params.tau < 0 || stream_end <= stream_begin) {
+        throw std::invalid_argument("Invalid Monte Carlo parameters");
+    }
+    std::uint64_t num_streams = stream_end - stream_begin;
+    std::size_t num_threads = static_cast<std::size_t>(
+        std::max<std::uint64_t>(1, std::min<std::uint64_t>(static_cast<std::uint64_t>(std::max(threads, 1)), num_streams)));
+
+    // Contiguous stream ranges per thread; tallies are added afterwards, so the order does not matter
+    std::vector<std::vector<std::uint64_t>> counts(num_threads);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        std::uint64_t begin = stream_begin + num_streams * t / num_threads;
+        std::uint64_t end = stream_begin + num_streams * (t + 1) / num_threads;
+        workers.emplace_back(sample_streams, std::cref(params), begin, end, std::ref(counts[t]));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    McResult result;
+    result.params = params;
+    if (num_streams > 0) {
+        result.streams.push_back({stream_begin, stream_end});
+    }
+    result.samples = num_streams * params.samples_per_stream;
+    for (const std::vector<std::uint64_t>& thread_counts : counts) {
+        for (std::size_t pnodes = 0; pnodes < thread_counts.size(); ++pnodes) {
+            if (thread_counts[pnodes] != 0) {
+                result.tally[static_cast<int>(pnodes)] += thread_counts[pnodes];
+            }
+        }
+    }
+    return result;
+}
+
+void write_mc_result(const std::string& path, const McResult& result) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(kMagic, sizeof(kMagic));
+        write_pod(out, static_cast<std::int32_t>(result.params.csp));
+        write_pod(out, static_cast<std::int32_t>(result.params.tau));
+        write_pod(out, static_cast<std::int32_t>(result.params.w_grind));
+        write_pod(out, static_cast<std::int64_t>(result.params.num_leaf));
+        write_pod(out, result.params.seed);
+        write_pod(out, result.params.samples_per_stream);
+        write_pod(out, static_cast<std::uint32_t>(result.streams.size()));
+        for (const auto& [begin, end] : result.streams) {
+            write_pod(out, begin);
+            write_pod(out, end);
+        }
+        write_pod(out, result.samples);
+        write_pod(out, static_cast<std::uint32_t>(result.tally.size()));
+        for (const auto& [pnodes, count] : result.tally) {
+            write_pod(out, static_cast<std::int32_t>(pnodes));
+            write_pod(out, count);
+        }
+        if (!out.flush()) {
+            throw std::runtime_error("Cannot write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot rename " + tmp + " to " + path);
+    }
+}
+
+McResult read_mc_result(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    char magic[sizeof(kMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error(path + " is not a Monte Carlo result");
+    }
+    McResult result;
+    result.params.csp = read_pod<std::int32_t>(in, path);
+    result.params.tau = read_pod<std::int32_t>(in, path);
+    result.params.w_grind = read_pod<std::int32_t>(in, path);
+    result.params.num_leaf = read_pod<std::int64_t>(in, path);
+    result.params.seed = read_pod<std::uint64_t>(in, path);
+    result.params.samples_per_stream = read_pod<std::uint64_t>(in, path);
+    std::uint32_t num_ranges = read_pod<std::uint32_t>(in, path);
+    for (std::uint32_t i = 0; i < num_ranges; ++i) {
+        std::uint64_t begin = read_pod<std::uint64_t>(in, path);
+        std::uint64_t end = read_pod<std::uint64_t>(in, path);
+        result.streams.push_back({begin, end});
+    }
+    result.samples = read_pod<std::uint64_t>(in, path);
+    std::uint32_t num_bins = read_pod<std::uint32_t>(in, path);
+    std::uint64_t tallied = 0;
+    for (std::uint32_t i = 0; i < num_bins; ++i) {
+        int pnodes = read_pod<std::int32_t>(in, path);
+        std::uint64_t count = read_pod<std::uint64_t>(in, path);
+        result.tally[pnodes] += count;
+        tallied += count;
+    }
+    if (tallied != result.samples) {
+        throw std::runtime_error(path + ": tally does not add up to the sample count");
+    }
+    return result;
+}
+
+void merge_mc_result(McResult& into, const McResult& other) {
+    const McParams& a = into.params;
+    const McParams& b = other.params;
+    if (a.csp != b.csp || a.tau != b.tau || a.w_grind != b.w_grind || a.num_leaf != b.num_leaf
+        || a.samples_per_stream != b.samples_per_stream) {
+        throw std::invalid_argument("Monte Carlo results have different parameters");
+    }
+    if (a.seed != b.seed) {
+        throw std::invalid_argument("Monte Carlo results have different seeds");
+    }
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> streams = into.streams;
+    streams.insert(streams.end(), other.streams.begin(), other.streams.end());
+    std::sort(streams.begin(), streams.end());
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> merged;
+    for (const auto& range : streams) {
+        if (!merged.empty() && range.first < merged.back().second) {
+            throw std::invalid_argument("Monte Carlo results share streams " + std::to_string(range.first)
+                                        + ".." + std::to_string(std::min(range.second, merged.back().second) - 1));
+        }
+        if (!merged.empty() && range.first == merged.back().second) {
+            merged.back().second = range.second; // Adjacent ranges coalesce
+        } else {
+            merged.push_back(range);
+        }
+    }
+    into.streams = std::move(merged);
+    into.samples += other.samples;
+    for (const auto& [pnodes, count] : other.tally) {
+        into.tally[pnodes] += count;
+    }
+}
+
+QuantileEstimate tally_quantile(const McResult& result, double p, double z) {
+    double n = static_cast<double>(result.samples);
+    // Value at a 1-based rank: the smallest count whose cumulative tally reaches it
+    auto value_at_rank = [&](double rank) {
+        std::uint64_t target = static_cast<std::uint64_t>(std::clamp(rank, 1.0, std::max(n, 1.0)));
+        std::uint64_t cumulative = 0;
+        for (const auto& [pnodes, count] : result.tally) {
+            cumulative += count;
+            if (cumulative >= target) {
+                return pnodes;
+            }
+        }
+        return result.tally.empty() ? 0 : result.tally.rbegin()->first;
+    };
+    double half_width = z * std::sqrt(n * p * (1 - p));
+    return {value_at_rank(std::ceil(n * p)),
+            value_at_rank(std::floor(n * p - half_width)),
+            value_at_rank(std::ceil(n * p + half_width))};
+}
@@ -0,0 +1,173 @@
+#ifndef MONTE_CARLO_H
+#define MONTE_CARLO_H
+
+#include "tree_utils.h" // For Histogram
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief What a Monte Carlo run sampled. Runs can only be merged if these agree.
+ */
+struct McParams {
+    int csp = 0;
+    int tau = 0;
+    int w_grind = 0;
+    long long num_leaf = 0;                // Derived from csp - w_grind and tau
+    std::uint64_t seed = 0;                // Streams of different seeds are independent
+    std::uint64_t samples_per_stream = 0;  // Every stream draws exactly this many challenges
+};
+
+/**
+ * @brief splitmix64: advances state by a fixed odd constant and returns it mixed.
+ *
+ * Seeds xoshiro256** state from small inputs (ChallengeStream) and drives the stratified sampler.
+ */
+inline std::uint64_t splitmix64(std::uint64_t& state) {
+    std::uint64_t x = (state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief The challenges of one RNG stream: sets of tau distinct leaves, uniformly at random.
+ *
+ * xoshiro256** seeded from (seed, stream), so a stream yields the same challenges on
+ * any machine and streams can be handed out independently. Leaves are picked with
+ * Floyd's algorithm and returned as heap indices in [num_leaf, 2 * num_leaf - 1].
+ */
+class ChallengeStream {
+public:
+    ChallengeStream(std::uint64_t seed, std::uint64_t stream, long long num_leaf, int tau);
+
+    /**
+     * @brief Replaces leaves by the next challenge (in pick order, not sorted).
+     */
+    void next(std::vector<long long>& leaves);
+
+private:
+    std::uint64_t next_word();
+    std::uint64_t below(std::uint64_t bound); // Uniform in [0, bound)
+    static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    long long num_leaf_;
+    int tau_;
+    std::uint64_t s_[4];
+};
+
+/**
+ * @brief Number of streams run_challenge_streams splits its samples over.
+ *
+ * Fixed, so results do not depend on the thread count.
+ */
+constexpr std::uint64_t kChallengeStreams = 64;
+
+/**
+ * @brief Feeds samples challenges (see ChallengeStream) to per-thread copies of prototype and merges them.
+ *
+ * The samples are split evenly over streams 0 .. kChallengeStreams - 1 of seed and the streams over
+ * threads, so the result does not depend on the thread count. Accumulator needs add(std::vector<long long>& leaves), which may reorder leaves, and
+ * merge(const Accumulator&).
+ */
+template <typename Accumulator>
+Accumulator run_challenge_streams(long long num_leaf, int tau, std::uint64_t samples, std::uint64_t seed,
+                                  int threads, const Accumulator& prototype) {
+    std::size_t num_threads = static_cast<std::size_t>(std::clamp<int>(threads, 1, static_cast<int>(kChallengeStreams)));
+    std::vector<Accumulator> parts(num_threads, prototype);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<long long> leaves;
+            for (std::uint64_t stream = kChallengeStreams * t / num_threads;
+                 stream < kChallengeStreams * (t + 1) / num_threads; ++stream) {
+                ChallengeStream challenges(seed, stream, num_leaf, tau);
+                std::uint64_t stream_samples = samples * (stream + 1) / kChallengeStreams
+                                             - samples * stream / kChallengeStreams;
+                for (std::uint64_t sample = 0; sample < stream_samples; ++sample) {
+                    challenges.next(leaves);
+                    parts[t].add(leaves);
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (std::size_t t = 1; t < num_threads; ++t) {
+        parts[0].merge(parts[t]);
+    }
+    return parts[0];
+}
+
+/**
+ * @brief Tally of the number of revealed nodes over a set of RNG streams.
+ *
+ * Stream s of seed k always produces the same samples, on any machine, so two results
+ * with overlapping streams would count samples twice; merge_mc_result refuses them.
+ */
+struct McResult {
+    McParams params;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> streams; // Sorted, disjoint [begin, end) ranges
+    std::uint64_t samples = 0;
+    std::map<int, std::uint64_t> tally; // Number of revealed nodes -> number of samples
+
+    /**
+     * @brief Returns the tally as frequencies, comparable with the exact histogram (empty without samples).
+     */
+    Histogram histogram() const;
+};
+
+/**
+ * @brief Draws samples_per_stream challenges (see ChallengeStream) for each stream in [stream_begin, stream_end).
+ *
+ * Each challenge is scored with count_copath_nodes. Streams are spread over threads; the result does not depend on
+ * the thread count. Throws std::invalid_argument if the stream range is empty.
+ */
+McResult sample_monte_carlo(const McParams& params, std::uint64_t stream_begin, std::uint64_t stream_end,
+                            int threads = 1);
+
+/**
+ * @brief Writes a result file.
+ *
+ * Layout (native endianness): the 8-byte magic "OTSMCRS1", int32 csp, int32 tau,
+ * int32 w_grind, int64 num_leaf, uint64 seed, uint64 samples_per_stream,
+ * uint32 number of stream ranges and (uint64 begin, uint64 end) per range,
+ * uint64 samples, uint32 number of bins and (int32 pnodes, uint64 count) per bin.
+ * Written to "<path>.tmp" and renamed. Throws std::runtime_error on I/O errors.
+ */
+void write_mc_result(const std::string& path, const McResult& result);
+
+/**
+ * @brief Reads a file written by write_mc_result. Throws std::runtime_error if it is malformed.
+ */
+McResult read_mc_result(const std::string& path);
+
+/**
+ * @brief Adds other into into.
+ *
+ * Throws std::invalid_argument if the parameters differ or if a stream appears in both.
+ */
+void merge_mc_result(McResult& into, const McResult& other);
+
+/**
+ * @brief A quantile of the revealed-node count with a distribution-free confidence interval.
+ */
+struct QuantileEstimate {
+    int value; // Smallest count whose empirical CDF reaches p, like the exact thresholds
+    int lower; // Interval from the binomial order statistics around rank n * p
+    int upper;
+};
+
+/**
+ * @brief Estimates the p-quantile of a tally.
+ * @param z Normal quantile of the confidence level (1.96 for 95%).
+ */
+QuantileEstimate tally_quantile(const McResult& result, double p, double z = 1.96);
+
+#endif // MONTE_CARLO_H
@@ -0,0 +1,211 @@
+#include "net.h"
+#include "telemetry.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib> // For std::strtol
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::runtime_error net_error(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Resolves host:port to an IPv4 address
+sockaddr_in resolve(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    int rc = getaddrinfo(host.c_str(), nullptr, &hints, &found);
+    if (rc != 0 || found == nullptr) {
+        throw std::runtime_error("Cannot resolve " + host + ": " + gai_strerror(rc));
+    }
+    sockaddr_in addr = *reinterpret_cast<sockaddr_in*>(found->ai_addr);
+    freeaddrinfo(found);
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    return addr;
+}
+
+void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+std::string address_string(const sockaddr_in& addr) {
+    char text[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, text, sizeof(text));
+    return text;
+}
+
+void send_all(int fd, const void* data, std::size_t len) {
+    const char* bytes = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t sent = ::send(fd, bytes, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            throw net_error("send failed");
+        }
+        bytes += sent;
+        len -= static_cast<std::size_t>(sent);
+    }
+}
+
+void recv_all(int fd, void* data, std::size_t len) {
+    char* bytes = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t got = ::recv(fd, bytes, len, 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            throw net_error("recv failed");
+        }
+        if (got == 0) {
+            throw std::runtime_error("Connection closed by peer");
+        }
+        bytes += got;
+        len -= static_cast<std::size_t>(got);
+    }
+}
+
+} // namespace
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    if (this != &other) {
+        reset();
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+void Socket::reset() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void Socket::shutdown() {
+    if (fd_ >= 0) {
+        ::shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+bool parse_host_port(const std::string& text, std::string& host, int& port) {
+    std::size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+    host = text.substr(0, colon);
+    char* end = nullptr;
+    long value = std::strtol(text.c_str() + colon + 1, &end, 10);
+    if (*end != '\0' || value < 0 || value > 65535) {
+        return false;
+    }
+    port = static_cast<int>(value);
+    return true;
+}
+
+Socket listen_tcp(const std::string& host, int port, int backlog) {
+    sockaddr_in addr = resolve(host, port);
+    Socket socket(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)); // Not inherited by exec'd workers
+    if (!socket.valid()) {
+        throw net_error("socket failed");
+    }
+    int one = 1;
+    setsockopt(socket.fd(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (::bind(socket.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw net_error("Cannot bind " + host + ":" + std::to_string(port));
+    }
+    if (::listen(socket.fd(), backlog) != 0) {
+        throw net_error("listen failed");
+    }
+    return socket;
+}
+
+Socket accept_tcp(const Socket& listener) {
+    while (true) {
+        int fd = ::accept4(listener.fd(), nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            set_nodelay(fd);
+            return Socket(fd);
+        }
+        if (errno != EINTR) {
+            throw net_error("accept failed");
+        }
+    }
+}
+
+Socket connect_tcp(const std::string& host, int port) {
+    sockaddr_in addr = resolve(host, port);
+    Socket socket(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)); // Not inherited by exec'd workers
+    if (!socket.valid()) {
+        throw net_error("socket failed");
+    }
+    if (::connect(socket.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw net_error("Cannot connect to " + host + ":" + std::to_string(port));
+    }
+    set_nodelay(socket.fd());
+    return socket;
+}
+
+int local_port(const Socket& socket) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    getsockname(socket.fd(), reinterpret_cast<sockaddr*>(&addr), &len);
+    return ntohs(addr.sin_port);
+}
+
+std::string local_address(const Socket& socket) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    getsockname(socket.fd(), reinterpret_cast<sockaddr*>(&addr), &len);
+    return address_string(addr);
+}
+
+std::string remote_address(const Socket& socket) {
+    sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    getpeername(socket.fd(), reinterpret_cast<sockaddr*>(&addr), &len);
+    return address_string(addr);
+}
+
+void send_message(const Socket& socket, MessageType type, const void* payload, std::size_t len) {
+    if (len > UINT32_MAX) {
+        throw std::runtime_error("Message payload too large");
+    }
+    unsigned char header[5];
+    header[0] = static_cast<unsigned char>(type);
+    std::uint32_t len32 = static_cast<std::uint32_t>(len);
+    std::memcpy(header + 1, &len32, sizeof(len32));
+    send_all(socket.fd(), header, sizeof(header));
+    if (len > 0) {
+        send_all(socket.fd(), payload, len);
+    }
+    telemetry().net_bytes_sent.fetch_add(static_cast<long long>(sizeof(header) + len), std::memory_order_relaxed);
+}
+
+MessageType recv_message(const Socket& socket, std::vector<unsigned char>& payload) {
+    unsigned char header[5];
+    recv_all(socket.fd(), header, sizeof(header));
+    std::uint32_t len;
+    std::memcpy(&len, header + 1, sizeof(len));
+    payload.resize(len);
+    if (len > 0) {
+        recv_all(socket.fd(), payload.data(), len);
+    }
+    return static_cast<MessageType>(header[0]);
+}
+
+void expect_message(const Socket& socket, MessageType type, std::vector<unsigned char>& payload) {
+    MessageType got = recv_message(socket, payload);
+    if (got != type) {
+        throw std::runtime_error("Unexpected message type " + std::to_string(static_cast<int>(got))
+                                 + " (expected " + std::to_string(static_cast<int>(type)) + ")");
+    }
+}
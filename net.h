@@ -0,0 +1,156 @@
+#ifndef NET_H
+#define NET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Message types of the sharded engine protocol (see sharded.h).
+ */
+enum class MessageType : std::uint8_t {
+    Hello = 1, // Worker -> coordinator: uint32 port the worker accepts peers on
+    Peers,     // Coordinator -> worker: shard id, shard count, run parameters, peer addresses
+    Step,      // Coordinator -> worker: uint32 picks to advance
+    Batch,     // Worker -> worker: encode_frontier run of transitions owned by the receiver
+    End,       // Worker -> worker: no more batches this step
+    Done,      // Worker -> coordinator: uint64 size of the new shard (the step barrier)
+    Reduce,    // Coordinator -> worker: uint32 picks of the final step, reduced locally
+    Hist,      // Worker -> coordinator: uint64 count, then (int32 value, double prob) pairs
+    Quit,      // Coordinator -> worker: shut down
+};
+
+/**
+ * @brief Owns a socket file descriptor and closes it on destruction.
+ */
+class Socket {
+public:
+    Socket() = default;
+    explicit Socket(int fd) : fd_(fd) {}
+    ~Socket() { reset(); }
+    Socket(Socket&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    Socket& operator=(Socket&& other) noexcept;
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    int fd() const { return fd_; }
+    bool valid() const { return fd_ >= 0; }
+    void reset();
+
+    /**
+     * @brief Shuts down both directions without closing, waking a thread blocked on the socket.
+     */
+    void shutdown();
+
+private:
+    int fd_ = -1;
+};
+
+/**
+ * @brief Splits "host:port" into its parts. Returns false if the text is malformed.
+ */
+bool parse_host_port(const std::string& text, std::string& host, int& port);
+
+/**
+ * @brief Creates a TCP socket listening on host:port (port 0 picks a free port).
+ */
+Socket listen_tcp(const std::string& host, int port, int backlog = 64);
+
+/**
+ * @brief Accepts one connection on a listening socket.
+ */
+Socket accept_tcp(const Socket& listener);
+
+/**
+ * @brief Connects to host:port, with TCP_NODELAY set.
+ */
+Socket connect_tcp(const std::string& host, int port);
+
+/**
+ * @brief Returns the local port of a bound socket.
+ */
+int local_port(const Socket& socket);
+
+/**
+ * @brief Returns the numeric address of the local or the remote end of a connected socket.
+ */
+std::string local_address(const Socket& socket);
+std::string remote_address(const Socket& socket);
+
+/**
+ * @brief Sends one framed message: uint8 type, uint32 payload length, payload.
+ *
+ * Throws std::runtime_error if the connection fails.
+ */
+void send_message(const Socket& socket, MessageType type, const void* payload = nullptr, std::size_t len = 0);
+
+inline void send_message(const Socket& socket, MessageType type, const std::vector<unsigned char>& payload) {
+    send_message(socket, type, payload.data(), payload.size());
+}
+
+/**
+ * @brief Receives one framed message into payload.
+ *
+ * Throws std::runtime_error if the connection fails or is closed.
+ */
+MessageType recv_message(const Socket& socket, std::vector<unsigned char>& payload);
+
+/**
+ * @brief Receives one message and checks its type; throws std::runtime_error on any other type.
+ */
+void expect_message(const Socket& socket, MessageType type, std::vector<unsigned char>& payload);
+
+/**
+ * @brief Appends the bytes of a trivially copyable value to a payload (native endianness).
+ */
+template <typename T>
+void put(std::vector<unsigned char>& payload, const T& value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    payload.insert(payload.end(), bytes, bytes + sizeof(T));
+}
+
+inline void put_string(std::vector<unsigned char>& payload, const std::string& value) {
+    put(payload, static_cast<std::uint32_t>(value.size()));
+    payload.insert(payload.end(), value.begin(), value.end());
+}
+
+/**
+ * @brief Reads values back from a payload, throwing std::runtime_error on truncation.
+ */
+class PayloadReader {
+public:
+    explicit PayloadReader(const std::vector<unsigned char>& payload)
+        : pos_(payload.data()), end_(payload.data() + payload.size()) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        need(sizeof(T));
+        std::memcpy(&value, pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    std::string get_string() {
+        std::uint32_t len = get<std::uint32_t>();
+        need(len);
+        std::string value(reinterpret_cast<const char*>(pos_), len);
+        pos_ += len;
+        return value;
+    }
+
+private:
+    void need(std::size_t bytes) const {
+        if (static_cast<std::size_t>(end_ - pos_) < bytes) {
+            throw std::runtime_error("Truncated message payload");
+        }
+    }
+
+    const unsigned char* pos_;
+    const unsigned char* end_;
+};
+
+#endif // NET_H
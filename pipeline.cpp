@@ -0,0 +1,211 @@
+#include "pipeline.h"
+#include "telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+TransitionPipeline::Emitter::Emitter(TransitionPipeline& pipeline, int expander)
+    : pipeline_(pipeline), expander_(expander), open_(pipeline.aggregators_, nullptr) {
+    for (int a = 0; a < pipeline_.aggregators_; ++a) {
+        open_[a] = pipeline_.lane(expander_, a).empty.pop(); // The lane was just refilled by run()
+    }
+}
+
+void TransitionPipeline::Emitter::send(std::size_t owner) {
+    Lane& lane = pipeline_.lane(expander_, static_cast<int>(owner));
+    lane.full.push(open_[owner]); // Never full: the ring holds the whole pool
+    open_[owner] = nullptr;
+    long long waits = 0;
+    TransitionBatch* batch;
+    while ((batch = lane.empty.pop()) == nullptr) {
+        if (stopped()) {
+            throw std::runtime_error("Pipeline stopped"); // Unwinds the expander; run() ignores it
+        }
+        ++waits;
+        std::this_thread::yield();
+    }
+    if (waits > 0) {
+        telemetry().pipeline_expander_waits.fetch_add(waits, std::memory_order_relaxed);
+    }
+    batch->items.clear();
+    batch->keys.clear();
+    open_[owner] = batch;
+}
+
+void TransitionPipeline::Emitter::finish() {
+    for (std::size_t a = 0; a < open_.size(); ++a) {
+        Lane& lane = pipeline_.lane(expander_, static_cast<int>(a));
+        if (open_[a] != nullptr && !open_[a]->items.empty()) {
+            lane.full.push(open_[a]);
+        } // An unused batch is simply dropped; run() refills the lanes from their pools
+        open_[a] = nullptr;
+        lane.done.store(true, std::memory_order_release);
+    }
+}
+
+TransitionPipeline::TransitionPipeline(int expanders, int aggregators, std::size_t insert_batch)
+    : expanders_(expanders), aggregators_(aggregators), insert_batch_(std::max<std::size_t>(1, insert_batch)) {
+    if (expanders < 1 || aggregators < 1) {
+        throw std::invalid_argument("Pipeline needs at least one expander and one aggregator");
+    }
+    for (int i = 0; i < expanders_ * aggregators_; ++i) {
+        auto lane = std::make_unique<Lane>();
+        for (std::size_t b = 0; b < kLaneBatches; ++b) {
+            auto batch = std::make_unique<TransitionBatch>();
+            batch->items.reserve(kBatchTransitions);
+            lane->pool.push_back(std::move(batch));
+        }
+        lanes_.push_back(std::move(lane));
+    }
+}
+
+TransitionPipeline::~TransitionPipeline() = default;
+
+void TransitionPipeline::aggregate(int aggregator, FrontierTable& table) {
+    long long batches = 0, queued = 0, waits = 0;
+    std::vector<bool> finished(expanders_, false);
+    int open_lanes = expanders_;
+    while (open_lanes > 0 && !stop_.load(std::memory_order_relaxed)) {
+        bool idle = true;
+        for (int e = 0; e < expanders_; ++e) {
+            if (finished[e]) continue;
+            Lane& lane = this->lane(e, aggregator);
+            // Read done before popping, so an empty pop after done means the lane is drained
+            bool done = lane.done.load(std::memory_order_acquire);
+            std::size_t waiting = lane.full.size();
+            TransitionBatch* batch = lane.full.pop();
+            if (batch == nullptr) {
+                if (done) {
+                    finished[e] = true;
+                    --open_lanes;
+                }
+                continue;
+            }
+            idle = false;
+            ++batches;
+            queued += static_cast<long long>(waiting);
+
+            // Same two-pass prefetch as BatchedInserter, over groups of insert_batch_ items
+            const std::vector<TransitionBatch::Item>& items = batch->items;
+            for (std::size_t begin = 0; begin < items.size(); begin += insert_batch_) {
+                std::size_t end = std::min(items.size(), begin + insert_batch_);
+                for (std::size_t i = begin; i < end; ++i) table.prefetch(items[i].hash);
+                for (std::size_t i = begin; i < end; ++i) table.prefetch_key(items[i].hash);
+                for (std::size_t i = begin; i < end; ++i) {
+                    table.add_hashed(items[i].hash, batch->keys.data() + items[i].offset, items[i].len, items[i].prob);
+                }
+            }
+            lane.empty.push(batch);
+        }
+        if (idle && open_lanes > 0) {
+            ++waits;
+            std::this_thread::yield();
+        }
+    }
+    Telemetry& stats = telemetry();
+    stats.pipeline_batches.fetch_add(batches, std::memory_order_relaxed);
+    stats.pipeline_queued_batches.fetch_add(queued, std::memory_order_relaxed);
+    stats.pipeline_aggregator_waits.fetch_add(waits, std::memory_order_relaxed);
+}
+
+bool TransitionPipeline::run(std::size_t expected_size, const FrontierLayout& layout,
+                             const std::function<void(int, Emitter&)>& expand,
+                             const std::function<void()>& caller_work, const std::function<bool()>& poll,
+                             std::vector<FrontierTable>& parts) {
+    // No thread is running: reset every lane to an empty full ring and a complete empty ring
+    for (auto& lane : lanes_) {
+        while (lane->full.pop() != nullptr) {
+        }
+        while (lane->empty.pop() != nullptr) {
+        }
+        for (auto& batch : lane->pool) {
+            batch->items.clear();
+            batch->keys.clear();
+            lane->empty.push(batch.get());
+        }
+        lane->done.store(false, std::memory_order_relaxed);
+    }
+    stop_.store(false, std::memory_order_relaxed);
+
+    parts.clear();
+    for (int a = 0; a < aggregators_; ++a) {
+        parts.emplace_back(expected_size / aggregators_ + 1, layout);
+    }
+    return drive(
+        aggregators_, [&](int a) { aggregate(a, parts[a]); },
+        expanders_,
+        [&](int e) {
+            Emitter emit(*this, e);
+            expand(e, emit);
+            emit.finish();
+        },
+        caller_work, poll);
+}
+
+bool TransitionPipeline::run_all(const std::function<void(int, const std::atomic<bool>&)>& work,
+                                 const std::function<void()>& caller_work, const std::function<bool()>& poll) {
+    stop_.store(false, std::memory_order_relaxed);
+    return drive(
+        0, [](int) {}, expanders_ + aggregators_, [&](int thread) { work(thread, stop_); }, caller_work, poll);
+}
+
+bool TransitionPipeline::drive(int aggregators, const std::function<void(int)>& aggregate, int workers,
+                               const std::function<void(int)>& work, const std::function<void()>& caller_work,
+                               const std::function<bool()>& poll) {
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto fail = [&] {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error && !stop_.load(std::memory_order_relaxed)) {
+            error = std::current_exception();
+        }
+        stop_.store(true, std::memory_order_relaxed);
+    };
+
+    std::atomic<int> workers_running{workers};
+    std::vector<std::thread> threads;
+    for (int a = 0; a < aggregators; ++a) {
+        threads.emplace_back([&, a] {
+            try {
+                aggregate(a);
+            } catch (...) {
+                fail();
+            }
+        });
+    }
+    for (int w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w] {
+            try {
+                work(w);
+            } catch (...) {
+                fail();
+            }
+            workers_running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    bool completed = true;
+    try {
+        caller_work();
+        while (workers_running.load(std::memory_order_acquire) > 0) {
+            if (!stop_.load(std::memory_order_relaxed) && !poll()) {
+                completed = false;
+                stop_.store(true, std::memory_order_relaxed);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    } catch (...) {
+        fail();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return completed;
+}
@@ -0,0 +1,213 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "frontier.h" // For FrontierTable
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free ring of pointers between one producer and one consumer thread.
+ *
+ * Each side keeps a private copy of the other side's index and only reloads the shared
+ * atomic when the copy says the ring is full (or empty), so a push or pop touches one
+ * shared cache line in the common case.
+ */
+template <typename T>
+class SpscRing {
+public:
+    /**
+     * @param capacity Number of pointers the ring holds, rounded up to a power of two.
+     */
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t size = 1;
+        while (size < capacity) size *= 2;
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Appends item. Producer only. Returns false if the ring is full.
+     */
+    bool push(T* item) {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) return false;
+        }
+        slots_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item. Consumer only. Returns nullptr if the ring is empty.
+     */
+    T* pop() {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return nullptr;
+        }
+        T* item = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return item;
+    }
+
+    /**
+     * @brief Number of queued items; exact from either side, a snapshot from any other thread.
+     */
+    std::size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T*> slots_;
+    std::size_t mask_ = 0;
+    alignas(64) std::atomic<std::size_t> head_{0}; // Written by the consumer
+    std::size_t cached_tail_ = 0;                  // Consumer's view of tail_
+    alignas(64) std::atomic<std::size_t> tail_{0}; // Written by the producer
+    std::size_t cached_head_ = 0;                  // Producer's view of head_
+};
+
+/**
+ * @brief Transitions on their way from one expander to one aggregator.
+ */
+struct TransitionBatch {
+    struct Item {
+        std::uint64_t hash;  // FrontierTable::hash_config of the key
+        std::uint32_t offset; // Into keys
+        std::uint32_t len;
+        double prob;
+    };
+    std::vector<Item> items;
+    std::vector<FrontierTable::Entry> keys; // Keys of the items, back to back
+};
+
+/**
+ * @brief Runs a step on expander threads feeding aggregator threads.
+ *
+ * Expanding configs is compute-bound (split lookups, config merges) while inserting
+ * successors is memory-bound (random slot accesses), so the two run on different
+ * threads. The next frontier is split by hash into one FrontierTable per aggregator,
+ * which only its aggregator touches. Every (expander, aggregator) pair has its own
+ * lane: an SpscRing of full batches towards the aggregator and one of empty batches
+ * back, so an aggregator consuming all its lanes forms a lock-free MPSC queue. A lane
+ * owns a fixed pool of batches; an expander that finds no empty batch waits, which is
+ * the backpressure. Lanes and their batches are reused from step to step.
+ *
+ * Occupancy is reported to telemetry: pipeline_queued_batches / pipeline_batches is
+ * the mean number of full batches waiting in a lane when its aggregator takes one
+ * (near kLaneBatches: aggregators are the bottleneck, move a thread to them; near 0:
+ * expanders are). pipeline_expander_waits and pipeline_aggregator_waits count the
+ * times either side found nothing to do.
+ */
+class TransitionPipeline {
+public:
+    using Entry = FrontierTable::Entry;
+
+    /**
+     * @brief Passed to the expand callback; sends transitions to their aggregators.
+     */
+    class Emitter {
+    public:
+        void operator()(const Entry* config, std::size_t len, double prob) {
+            std::uint64_t hash = FrontierTable::hash_config(config, len);
+            std::size_t owner = static_cast<std::size_t>((hash >> 32) % open_.size());
+            TransitionBatch* batch = open_[owner];
+            batch->items.push_back({hash, static_cast<std::uint32_t>(batch->keys.size()),
+                                    static_cast<std::uint32_t>(len), prob});
+            batch->keys.insert(batch->keys.end(), config, config + len);
+            if (batch->items.size() >= kBatchTransitions) {
+                send(owner);
+            }
+        }
+
+        /**
+         * @brief True once the step is being abandoned; expanders should return soon.
+         */
+        bool stopped() const { return pipeline_.stop_.load(std::memory_order_relaxed); }
+
+    private:
+        friend class TransitionPipeline;
+        Emitter(TransitionPipeline& pipeline, int expander);
+
+        void send(std::size_t owner); // Queues the open batch of owner and takes an empty one
+        void finish();                // Queues the partial batches and closes this expander's lanes
+
+        TransitionPipeline& pipeline_;
+        int expander_;
+        std::vector<TransitionBatch*> open_; // Batch being filled, per aggregator
+    };
+
+    static constexpr std::size_t kBatchTransitions = 1024;
+    static constexpr std::size_t kLaneBatches = 8;
+
+    /**
+     * @param insert_batch Inserts prefetched per group by the aggregators (as in BatchedInserter).
+     */
+    TransitionPipeline(int expanders, int aggregators, std::size_t insert_batch);
+    ~TransitionPipeline();
+    TransitionPipeline(const TransitionPipeline&) = delete;
+    TransitionPipeline& operator=(const TransitionPipeline&) = delete;
+
+    int expanders() const { return expanders_; }
+    int aggregators() const { return aggregators_; }
+
+    /**
+     * @brief Runs one step.
+     *
+     * Calls expand(expander, emit) on each expander thread, then caller_work() on the
+     * calling thread, then poll() on the calling thread about every millisecond until the
+     * expanders are done; poll() returning false abandons the step.
+     * @param expected_size Number of configs to size the aggregator tables for, in total.
+     * @param layout Allocation knobs of the aggregator tables.
+     * @param parts Receives one table per aggregator, holding disjoint hash ranges.
+     * @return False if the step was abandoned. Exceptions from the threads are rethrown.
+     */
+    bool run(std::size_t expected_size, const FrontierLayout& layout, const std::function<void(int, Emitter&)>& expand,
+             const std::function<void()>& caller_work, const std::function<bool()>& poll,
+             std::vector<FrontierTable>& parts);
+
+    /**
+     * @brief Runs a step that builds no next frontier, such as the reduced final step.
+     *
+     * There is nothing to aggregate, so all expanders() + aggregators() threads call
+     * work(thread, stop) and should return soon once stop is set. caller_work and poll
+     * are used as in run().
+     * @return False if the step was abandoned. Exceptions from the threads are rethrown.
+     */
+    bool run_all(const std::function<void(int, const std::atomic<bool>&)>& work,
+                 const std::function<void()>& caller_work, const std::function<bool()>& poll);
+
+private:
+    struct Lane {
+        SpscRing<TransitionBatch> full{kLaneBatches};  // Expander -> aggregator
+        SpscRing<TransitionBatch> empty{kLaneBatches}; // Aggregator -> expander
+        std::atomic<bool> done{false};                 // Set by the expander after its last push
+        std::vector<std::unique_ptr<TransitionBatch>> pool;
+    };
+
+    Lane& lane(int expander, int aggregator) { return *lanes_[expander * aggregators_ + aggregator]; }
+    void aggregate(int aggregator, FrontierTable& table);
+    // Starts aggregate(a) on aggregators threads and work(w) on workers threads, then polls as in run()
+    bool drive(int aggregators, const std::function<void(int)>& aggregate, int workers,
+               const std::function<void(int)>& work, const std::function<void()>& caller_work,
+               const std::function<bool()>& poll);
+
+    int expanders_;
+    int aggregators_;
+    std::size_t insert_batch_;
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    std::atomic<bool> stop_{false};
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,63 @@
+"""共享目录队列的端到端测试：3 个本地 my_app --queue-worker 处理同一临时目录，每个点必须恰好计算一次
+
+用法: python3 queue_test.py <my_app 路径>
+"""
+import os
+import subprocess
+import sys
+import tempfile
+import time
+from collections import Counter
+from pathlib import Path
+
+from batch_run import QUEUE_SUBDIRS, point_name, publish_points
+
+POINTS = [(64, 10, 0), (64, 12, 0), (96, 11, 0), (96, 12, 0), (100, 12, 0), (104, 12, 0)]
+WORKERS = 3
+LEASE_SECONDS = 30  # 心跳每 10 秒才续约一次，所以领取时的 mtime 决定租约是否看起来已过期
+
+def main():
+    app = Path(sys.argv[1]).absolute()
+    with tempfile.TemporaryDirectory() as tmp:
+        queue_dir = Path(tmp)
+        assert publish_points(queue_dir, POINTS) == len(POINTS)
+        # 模拟很久以前发布的点：领取后的租约不能因此被当作已过期
+        hour_ago = time.time() - 3600
+        for name in os.listdir(queue_dir / 'pending'):
+            os.utime(queue_dir / 'pending' / name, (hour_ago, hour_ago))
+
+        cmd = [str(app), '--queue-worker', str(queue_dir), '--lease-seconds', str(LEASE_SECONDS), '--no-tune']
+        workers = [subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+                   for _ in range(WORKERS)]
+        logs = [worker.communicate(timeout=600)[1] for worker in workers]
+
+        runs = Counter()
+        for log in logs:
+            for line in log.splitlines():
+                if ' running ' in line:
+                    runs[line.split(' running ')[1].strip()] += 1
+                if line.startswith('Reclaimed expired lease'):
+                    print(line)
+        failed = False
+        for worker in workers:
+            if worker.returncode != 0:
+                print(f'Worker exited with status {worker.returncode}')
+                failed = True
+        for point in POINTS:
+            name = point_name(*point)
+            if runs[name] != 1:
+                print(f'{name} computed {runs[name]} times')
+                failed = True
+            if not (queue_dir / 'results' / name).exists():
+                print(f'{name} has no result')
+                failed = True
+        for sub in QUEUE_SUBDIRS[:2]:
+            if os.listdir(queue_dir / sub):
+                print(f'{sub}/ not empty: {os.listdir(queue_dir / sub)}')
+                failed = True
+        if failed:
+            sys.exit(1)
+        print(f'{len(POINTS)} points computed once each by {WORKERS} workers')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,201 @@
+#ifndef REDUCERS_H
+#define REDUCERS_H
+
+#include "tree_utils.h" // For Histogram
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Reducers consume the final step of sample_reduce (see step_engine.h). A reducer is
+// any type with
+//     void add(const std::pair<int, int>* config, std::size_t len, double prob);
+// which may be called several times for the same config. All reducers here are
+// linear in prob, so repeated calls simply accumulate. For a pipelined final step
+// (EngineOptions::pipeline_expanders) a reducer also needs
+//     void clear();                     // Drop all added mass, keep the parameters
+//     void merge(const Reducer& other); // Add the mass of other
+// so each thread can fill its own copy.
+
+/**
+ * @brief Number of revealed nodes (co-path nodes) of a config: the sum of counts.
+ */
+struct PnodeCount {
+    int operator()(const std::pair<int, int>* config, std::size_t len) const {
+        int num_pnodes = 0;
+        for (std::size_t i = 0; i < len; ++i) {
+            num_pnodes += config[i].second;
+        }
+        return num_pnodes;
+    }
+};
+
+/**
+ * @brief Leaf count of the largest revealed subtree (0 if nothing is revealed).
+ */
+struct LargestSubtree {
+    int operator()(const std::pair<int, int>* config, std::size_t len) const {
+        return len == 0 ? 0 : config[len - 1].first; // Configs are sorted by size
+    }
+};
+
+/**
+ * @brief Size of an opening in bytes: fixed_bytes plus node_bytes per revealed node.
+ */
+struct OpeningBytes {
+    int node_bytes = 16;
+    int fixed_bytes = 0;
+
+    int operator()(const std::pair<int, int>* config, std::size_t len) const {
+        return fixed_bytes + node_bytes * PnodeCount()(config, len);
+    }
+};
+
+/**
+ * @brief Histogram of an integer projection of the final configs.
+ *
+ * Small values go to a dense array (the common case for node counts); large ones,
+ * such as subtree sizes of huge trees, to a map.
+ */
+template <typename Projection>
+class ProjectionHistogram {
+public:
+    explicit ProjectionHistogram(Projection projection = Projection()) : projection_(projection) {}
+
+    void add(const std::pair<int, int>* config, std::size_t len, double prob) {
+        int value = projection_(config, len);
+        if (value >= 0 && value < kDenseLimit) {
+            if (static_cast<std::size_t>(value) >= dense_.size()) {
+                dense_.resize(static_cast<std::size_t>(value) + 1, 0.0);
+            }
+            dense_[static_cast<std::size_t>(value)] += prob;
+        } else {
+            sparse_[value] += prob;
+        }
+    }
+
+    void clear() {
+        dense_.clear();
+        sparse_.clear();
+    }
+
+    void merge(const ProjectionHistogram& other) {
+        if (other.dense_.size() > dense_.size()) {
+            dense_.resize(other.dense_.size(), 0.0);
+        }
+        for (std::size_t value = 0; value < other.dense_.size(); ++value) {
+            dense_[value] += other.dense_[value];
+        }
+        for (const auto& [value, prob] : other.sparse_) {
+            sparse_[value] += prob;
+        }
+    }
+
+    /**
+     * @brief Returns (value, probability) pairs sorted by value, skipping empty bins.
+     */
+    Histogram result() const {
+        Histogram hist;
+        for (const auto& [value, prob] : sparse_) {
+            if (value < 0) hist.push_back({value, prob});
+        }
+        for (std::size_t value = 0; value < dense_.size(); ++value) {
+            if (dense_[value] != 0.0) hist.push_back({static_cast<int>(value), dense_[value]});
+        }
+        for (const auto& [value, prob] : sparse_) {
+            if (value >= kDenseLimit) hist.push_back({value, prob});
+        }
+        return hist;
+    }
+
+private:
+    static constexpr int kDenseLimit = 1 << 16;
+
+    Projection projection_;
+    std::vector<double> dense_;
+    std::map<int, double> sparse_;
+};
+
+/**
+ * @brief The distribution of the number of revealed nodes, what get_hist computes.
+ */
+using PnodeHistogram = ProjectionHistogram<PnodeCount>;
+
+/**
+ * @brief Joint distribution of two projections, e.g. (pnodes, bytes).
+ */
+template <typename ProjectionA, typename ProjectionB>
+class JointHistogram {
+public:
+    JointHistogram(ProjectionA a = ProjectionA(), ProjectionB b = ProjectionB()) : a_(a), b_(b) {}
+
+    void add(const std::pair<int, int>* config, std::size_t len, double prob) {
+        hist_[{a_(config, len), b_(config, len)}] += prob;
+    }
+
+    void clear() { hist_.clear(); }
+
+    void merge(const JointHistogram& other) {
+        for (const auto& [values, prob] : other.hist_) {
+            hist_[values] += prob;
+        }
+    }
+
+    /**
+     * @brief Returns ((value_a, value_b), probability) sorted by value_a, then value_b.
+     */
+    const std::map<std::pair<int, int>, double>& result() const { return hist_; }
+
+private:
+    ProjectionA a_;
+    ProjectionB b_;
+    std::map<std::pair<int, int>, double> hist_;
+};
+
+/**
+ * @brief Expected number of revealed nodes per subtree height (ceil(log2(size))).
+ *
+ * A revealed subtree of height h costs h levels of PRG/hash work to expand, so this
+ * profile is what the verifier's expansion cost depends on.
+ */
+class HeightProfile {
+public:
+    void add(const std::pair<int, int>* config, std::size_t len, double prob) {
+        for (std::size_t i = 0; i < len; ++i) {
+            unsigned size = static_cast<unsigned>(config[i].first);
+            std::size_t height = size <= 1 ? 0 : static_cast<std::size_t>(32 - __builtin_clz(size - 1));
+            if (height >= expected_.size()) {
+                expected_.resize(height + 1, 0.0);
+            }
+            expected_[height] += prob * config[i].second;
+        }
+    }
+
+    void clear() { expected_.clear(); }
+
+    void merge(const HeightProfile& other) {
+        if (other.expected_.size() > expected_.size()) {
+            expected_.resize(other.expected_.size(), 0.0);
+        }
+        for (std::size_t height = 0; height < other.expected_.size(); ++height) {
+            expected_[height] += other.expected_[height];
+        }
+    }
+
+    /**
+     * @brief Returns (height, expected number of revealed nodes) pairs.
+     */
+    std::vector<std::pair<int, double>> result() const {
+        std::vector<std::pair<int, double>> profile;
+        for (std::size_t height = 0; height < expected_.size(); ++height) {
+            profile.push_back({static_cast<int>(height), expected_[height]});
+        }
+        return profile;
+    }
+
+private:
+    std::vector<double> expected_;
+};
+
+#endif // REDUCERS_H
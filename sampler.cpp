@@ -1,5 +1,9 @@
 #include "sampler.h"
 #include "tree_utils.h" // Ensure all necessary functions are included
+#include "step_engine.h" // For StepEngine, sample_reduce
+#include "reducers.h"    // For PnodeHistogram
+#include "split_table.h" // For SplitTable
+#include "telemetry.h"   // For reset_telemetry
 
 #include <cmath>     // For std::pow, std::log2
 #include <vector>
@@ -9,7 +13,6 @@
 #include <stdexcept> // For potential error handling
 #include <optional>
 #include <limits>    // For std::numeric_limits
-#include <chrono>    // For timing measurements
 
 // Helper function to calculate 2^n safely using long long
 long long power_of_2(int n) {
@@ -23,166 +26,52 @@ long long power_of_2(int n) {
 
 
 Distribution sample_once(int num_leaf) {
-    Distribution dist;
     if (num_leaf <= 0) {
-        // Handle invalid input
-        return dist; // Return empty distribution
-    }
-    int leaf_min = num_leaf; // Smallest index if it were a full tree ending here
-    int leaf_max = 2 * num_leaf - 1; // Largest index
-
-    int left_depth = get_depth(leaf_max); // Depth of the deepest node
-    int right_depth = get_depth(leaf_min); // Depth of the shallowest node in the last level
-
-    // Full binary tree case
-    if (left_depth == right_depth) {
-        Config full_tree_config;
-        for (int i = 0; i < left_depth; ++i) {
-            full_tree_config.push_back({power_of_2(i), 1}); // Each level contributes 2^i nodes
-        }
-        dist[make_config(full_tree_config)] = 1.0; // Full tree configuration
-        return dist; // Return the distribution for a full binary tree
+        return {}; // Return empty distribution for invalid input
     }
+    return SplitTable(num_leaf).distribution(num_leaf);
+}
 
 
-    // Non-full binary tree case
-    int num_shallow = power_of_2(left_depth) - num_leaf;
-    int num_left, num_right = 0;
-    if (num_shallow <= power_of_2(right_depth - 1)) {
-        // left tree is a fbt
-        num_left = power_of_2(left_depth - 1);
-        num_right = num_leaf - num_left;
-    } else {
-        // right tree is a fbt
-        num_right = power_of_2(right_depth - 1);
-        num_left = num_leaf - num_right;
+Distribution sample(int num_leaf, int steps, const EngineOptions& options) {
+    if (num_leaf <= 0 || steps < 0) {
+        return {}; // Return empty distribution for invalid input
     }
 
-    // Sample from left and right subtree
-    for (int num_subtree_leaf : {num_left, num_right}) {
-        int num_rest = num_leaf - num_subtree_leaf;
-
-        // Probability of choosing a leaf from this subtree
-        double prob_subtree = static_cast<double>(num_subtree_leaf) / num_leaf;
-
-        // Recursively get the distribution for the chosen subtree
-        Distribution dist_subtree = sample_once(num_subtree_leaf);
-
-        // Create the config representing the remaining part
-        const Config config_rest = make_config({{num_rest, 1}}); // Config with one entry for the other subtree
-
-        // Combine results
-        for (const auto& pair : dist_subtree) {
-            const Config& pnodes = pair.first;
-            double sub_prob = pair.second;
-
-            Config new_config = add_config(pnodes, config_rest);
-            dist[new_config] += prob_subtree * sub_prob; // Add probability to this combined config
-        }
+    reset_telemetry();
+    StepEngine engine(num_leaf, steps, options);
+    while (engine.steps_done() < steps) {
+        engine.advance_scheduled();
     }
-    return dist;
-
+    engine.finish();
+    return engine.to_distribution();
 }
 
 
-Distribution sample(int num_leaf, int steps) {
-    using namespace std::chrono;
-    long long total_sample_once_time = 0;
-    auto total_start = high_resolution_clock::now();
-    
+PartialSample sample_cancellable(int num_leaf, int steps, const SampleControl& control, const EngineOptions& options) {
+    PartialSample result;
     if (num_leaf <= 0 || steps < 0) {
-        return {}; // Return empty distribution for invalid input
+        result.complete = true;
+        return result; // Empty distribution for invalid input, as in sample()
     }
 
-    DpCache dp; // Dynamic programming cache
-
-    // Initial distribution: starts with one tree of size num_leaf
-    Distribution dist;
-    dist[make_config({{num_leaf, 1}})] = 1.0;
-
-    for (int i = 0; i < steps; ++i) {
-        // Optional: Print progress
-        std::cerr << i << "-th step (out of " << steps << ")" << std::endl;
-        int remaining_leaves = num_leaf - i; // Remaining leaves after i splits
-
-        Distribution new_dist;
-        for (const auto& config_prob_pair : dist) {
-            const Config& config = config_prob_pair.first;
-            double prob = config_prob_pair.second; // Probability of current config
-
-            for (const auto& size_count_pair : config) {
-                int subtree_size = size_count_pair.first;
-                int num_subtree = size_count_pair.second; // Count of subtrees of this size
-
-                // Try to use dynamic programming cache
-                Distribution subtree_dist;
-                auto dp_it = dp.find(subtree_size);
-                if (dp_it == dp.end()) {
-                    // Not in cache, compute and store
-
-                    auto start = high_resolution_clock::now().time_since_epoch().count();
-                    subtree_dist = sample_once(subtree_size);
-                    auto end = high_resolution_clock::now().time_since_epoch().count();
-                    total_sample_once_time += (end - start) / 1000; // convert to microseconds
-                    dp[subtree_size] = subtree_dist;
-                } else {
-                    // Found in cache
-                    subtree_dist = dp_it->second;
-                }
-
-                double subtree_prob = prob * (static_cast<double>(subtree_size * num_subtree) / remaining_leaves);
-
-                if (subtree_prob == 0) continue;
-
-
-                for (const auto& sub_config_prob_pair : subtree_dist) {
-                    const Config& subtree_config = sub_config_prob_pair.first; // Resulting config from splitting one subtree
-                    double subtree_config_prob = sub_config_prob_pair.second; // Prob of that specific split result
-
-                    // Create the new overall config:
-                    // 1. Decrease the count of the split subtree size
-                    std::optional<Config> temp_config_opt = decrease_config(config, subtree_size);
-                    if (!temp_config_opt) {
-                         // This should not happen if the config iteration is correct
-                         std::cerr << "Error: decrease_config failed unexpectedly for size " << subtree_size << std::endl;
-                         continue;
-                    }
-                    Config new_config_base = *temp_config_opt;
-
-                    // 2. Add the components from the split result
-                    Config final_new_config = add_config(new_config_base, subtree_config);
-
-                    // The probability of reaching this final_new_config via this path:
-                    double new_prob = subtree_prob * subtree_config_prob;
-
-                    // Add this probability to the new distribution map
-                    new_dist[final_new_config] += new_prob;
-                }
-            }
-        }
-        dist = new_dist; // Update the distribution for the next step
-
+    reset_telemetry();
+    StepEngine engine(num_leaf, steps, options);
+    engine.set_control(&control);
+    bool cancelled = false;
+    while (!cancelled && engine.steps_done() < steps) {
+        cancelled = !engine.advance_scheduled();
     }
-
-    auto total_end = high_resolution_clock::now();
-    auto total_duration = duration_cast<microseconds>(total_end - total_start);
-
-    std::cerr << "Total sample execution time: " 
-              << total_duration.count() / 1000.0
-              << " ms" << std::endl;
-
-    std::cerr << "Total sample_once execution time: " 
-              << total_sample_once_time 
-              << " ms" << std::endl;
-    return dist;
+    engine.finish();
+    result.complete = !cancelled;
+    result.steps_done = engine.steps_done();
+    result.frontier = engine.to_distribution();
+    return result;
 }
 
 
-Histogram get_hist_randonetree(int csp, int tau) {
-     if (tau <= 0) {
-        // Handle invalid tau
-        return {}; // Return empty histogram
-    }
+// Total initial leaves of the trees _vc_param picks for (csp, tau); 0 if there are none
+static int randonetree_leaves(int csp, int tau) {
     // Get VC parameters
     auto [t0, k0, t1, k1] = _vc_param(csp, tau);
 
@@ -197,7 +86,16 @@ Histogram get_hist_randonetree(int csp, int tau) {
     if (L_ll > std::numeric_limits<int>::max()) {
          throw std::overflow_error("Calculated L exceeds integer limits");
     }
-    int L = static_cast<int>(L_ll);
+    return L_ll > 0 ? static_cast<int>(L_ll) : 0;
+}
+
+
+Histogram get_hist_randonetree(int csp, int tau) {
+     if (tau <= 0) {
+        // Handle invalid tau
+        return {}; // Return empty histogram
+    }
+    int L = randonetree_leaves(csp, tau);
 
     if (L <= 0) {
         // Handle cases where L is not positive (e.g., if csp is 0)
@@ -206,10 +104,50 @@ Histogram get_hist_randonetree(int csp, int tau) {
 
     // Perform the sampling
     // The number of steps should be tau, as per the Python code.
-    Distribution final_dist = sample(L, tau);
+    // The histogram is reduced from the final step's transitions, without building the final distribution.
+    PnodeHistogram hist;
+    sample_reduce(L, tau, hist);
+
+    return hist.result();
+}
 
-    // Calculate the histogram from the final distribution
-    Histogram hist = get_hist(final_dist);
 
-    return hist;
+PartialHistogram get_hist_randonetree(int csp, int tau, const SampleControl& control, const EngineOptions& options) {
+    PartialHistogram result;
+    if (tau <= 0) {
+        result.complete = true;
+        return result;
+    }
+    int L = randonetree_leaves(csp, tau);
+    if (L <= 0) {
+        result.complete = true;
+        return result;
+    }
+
+    // Steps as in sample_reduce; if one is cancelled, the last finished frontier is projected instead
+    reset_telemetry();
+    StepEngine engine(L, tau, options);
+    engine.set_control(&control);
+    bool cancelled = false;
+    while (!cancelled && tau - engine.steps_done() > engine.next_picks()) {
+        cancelled = !engine.advance_scheduled();
+    }
+    PnodeHistogram hist;
+    auto add = [&](const StepEngine::Entry* config, std::size_t len, double prob) {
+        hist.add(config, len, prob);
+    };
+    if (!cancelled && engine.steps_done() < tau) {
+        cancelled = !engine.reduce_scheduled_into(hist);
+        if (cancelled) {
+            hist = PnodeHistogram(); // Only part of the final step was reduced
+        }
+    }
+    if (cancelled || engine.steps_done() == tau) {
+        engine.for_each_config(add); // The last finished frontier (or a checkpoint resumed at tau)
+    }
+    engine.finish();
+    result.complete = !cancelled;
+    result.steps_done = cancelled ? engine.steps_done() : tau;
+    result.histogram = hist.result();
+    return result;
 }
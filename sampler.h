@@ -2,14 +2,39 @@
 #define SAMPLER_H
 
 #include "tree_utils.h" // Includes Config, Distribution, Histogram, etc.
+#include "hugepage.h"   // For HugePagePolicy
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
+#include <string>
 #include <vector>
 
 // Type alias for the dynamic programming cache used in sample
 using DpCache = std::map<int, Distribution>;
 
+/**
+ * @brief Tuning knobs of the step engine. Defaults reproduce the plain serial behaviour.
+ */
+struct EngineOptions {
+    HugePagePolicy hugepages = HugePagePolicy::Madvise; // Backing of frontier tables and key arenas
+    int insert_batch = 32;                              // Transitions hashed and prefetched per group (1 = unbatched)
+    int max_load_percent = 50;                          // Frontier tables grow beyond this load
+    std::size_t arena_block_bytes = 4 * kHugePageSize;  // Key arena allocation granularity
+    bool fuse_two_picks = false;                        // Advance two picks per pass using the two-pick split tables
+    int approx_cutoff = 0;                              // If > 0, merge configs differing only below this subtree size
+    bool compress_frontier = false;                     // Hold the frontier being expanded as delta-encoded blocks
+    std::string checkpoint_path;                        // If set, each step's input frontier is checkpointed here
+    std::string resume_path;                            // If set, start from this checkpoint instead of step 0
+    int pipeline_expanders = 0;                         // With pipeline_aggregators, run advance() as a thread
+    int pipeline_aggregators = 0;                       // pipeline: expanders feed aggregators (see pipeline.h)
+    bool quiet = false;                                 // No per-step progress or end-of-run report on stderr
+};
+
 /**
  * @brief Performs one step of the sampling process for a given number of leaves.
+ *
+ * Builds a SplitTable for num_leaf; the engine keeps that table instead of calling this.
  * @param num_leaf The number of leaves in the current (sub)tree.
  * @return A Distribution representing the possible configurations and their probabilities after one split.
  */
@@ -17,11 +42,79 @@ Distribution sample_once(int num_leaf);
 
 /**
  * @brief Performs the sampling process for a specified number of steps.
+ *
+ * Like the other entry points here and sample_reduce(), zeroes the telemetry counters
+ * first, so the report printed at the end covers this run only.
  * @param num_leaf The initial number of leaves.
  * @param steps The number of sampling steps to perform.
+ * @param options Engine tuning knobs.
  * @return The final Distribution after the specified number of steps.
  */
-Distribution sample(int num_leaf, int steps);
+Distribution sample(int num_leaf, int steps, const EngineOptions& options = EngineOptions());
+
+/**
+ * @brief Lets another thread stop a sample_cancellable() call.
+ */
+class CancellationToken {
+public:
+    void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> cancelled_{false};
+};
+
+/**
+ * @brief Where a cancellable run is, as passed to SampleControl::progress.
+ */
+struct SampleProgress {
+    int step = 0;                  // Steps finished
+    int steps = 0;                 // Steps requested
+    std::size_t configs_done = 0;  // Configs of the current frontier expanded so far in this step
+    std::size_t configs_total = 0; // Configs in the current frontier
+    double seconds = 0;            // Since the run started
+};
+
+/**
+ * @brief Cancellation and progress reporting for sample_cancellable().
+ *
+ * Checked before every step and after every chunk_configs expanded configs, on the
+ * sampling thread.
+ */
+struct SampleControl {
+    const CancellationToken* cancel = nullptr;                                 // Optional
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::function<void(const SampleProgress&)> progress;                      // Optional
+    std::size_t chunk_configs = 4096;
+};
+
+/**
+ * @brief Result of a cancellable run: the last frontier that was finished.
+ */
+struct PartialSample {
+    bool complete = false;  // False if cancelled before all steps were done
+    int steps_done = 0;     // Steps applied to frontier
+    Distribution frontier;
+};
+
+/**
+ * @brief sample() that can be cancelled through control.
+ *
+ * On cancellation the step in progress is dropped and the frontier of the last
+ * finished step is returned. Checkpoints (options.checkpoint_path) keep working, so a
+ * cancelled run can also be resumed later with options.resume_path.
+ */
+PartialSample sample_cancellable(int num_leaf, int steps, const SampleControl& control,
+                                 const EngineOptions& options = EngineOptions());
+
+/**
+ * @brief Histogram projection of a cancellable run.
+ */
+struct PartialHistogram {
+    bool complete = false;
+    int steps_done = 0;     // Picks the histogram accounts for (tau if complete)
+    Histogram histogram;    // Revealed-node distribution after steps_done picks
+};
 
 /**
  * @brief Calculates the histogram of node counts based on VC parameters and sampling.
@@ -31,5 +124,13 @@ Distribution sample(int num_leaf, int steps);
  */
 Histogram get_hist_randonetree(int csp, int tau);
 
+/**
+ * @brief get_hist_randonetree() that can be cancelled through control.
+ *
+ * On cancellation the histogram of the last finished step is returned.
+ */
+PartialHistogram get_hist_randonetree(int csp, int tau, const SampleControl& control,
+                                      const EngineOptions& options = EngineOptions());
+
 
 #endif // SAMPLER_H
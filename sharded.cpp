@@ -0,0 +1,477 @@
+#include "sharded.h"
+#include "net.h"
+#include "step_engine.h"
+#include "reducers.h"            // For PnodeHistogram
+#include "compressed_frontier.h" // For encode_frontier, decode_frontier
+#include "telemetry.h"
+#include "approx.h"              // For coarse_signature
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring> // For std::memset
+#include <exception>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Run parameters sent to every worker in the Peers message
+struct ShardPlan {
+    std::uint32_t id;
+    std::uint32_t shards;
+    std::int32_t num_leaf;
+    std::int32_t steps;
+    std::int32_t insert_batch;
+    std::int32_t approx_cutoff;
+    std::uint8_t hugepages;
+    std::uint8_t compress_frontier;
+    std::uint64_t batch_configs;
+    std::int32_t max_load_percent;
+    std::uint64_t arena_block_bytes;
+};
+
+struct PeerAddress {
+    std::string host;
+    int port;
+};
+
+std::uint32_t owner_of(std::uint64_t hash, std::uint32_t shards) {
+    // The table indexes slots with the low bits, so route on the high ones
+    return static_cast<std::uint32_t>((hash >> 32) % shards);
+}
+
+// Local workers forked by the coordinator; killed if the run fails
+class ChildProcesses {
+public:
+    ~ChildProcesses() {
+        for (pid_t pid : pids_) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    void add(pid_t pid) { pids_.push_back(pid); }
+
+    // Waits for all workers to exit; throws if one failed
+    void wait_all() {
+        std::vector<pid_t> pids;
+        pids.swap(pids_);
+        int failed = 0;
+        for (pid_t pid : pids) {
+            int status = 0;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                ++failed;
+            }
+        }
+        if (failed > 0) {
+            throw std::runtime_error(std::to_string(failed) + " shard worker(s) exited abnormally");
+        }
+    }
+
+private:
+    std::vector<pid_t> pids_;
+};
+
+// Shard that owns a config. With --approx-cutoff, configs are routed by their coarse signature,
+// so every coarsening group lives on one shard and coarsen_frontier per shard equals the global one
+class ShardRouter {
+public:
+    ShardRouter(std::uint32_t shards, int approx_cutoff) : shards_(shards), approx_cutoff_(approx_cutoff) {}
+
+    // hash is FrontierTable::hash_config of the config
+    std::uint32_t owner(const FrontierTable::Entry* config, std::size_t len, std::uint64_t hash) {
+        if (approx_cutoff_ > 0) {
+            coarse_signature(config, len, approx_cutoff_, signature_);
+            hash = FrontierTable::hash_config(signature_.data(), signature_.size());
+        }
+        return owner_of(hash, shards_);
+    }
+
+private:
+    std::uint32_t shards_;
+    int approx_cutoff_;
+    Config signature_;
+};
+
+class ShardWorker {
+public:
+    ShardWorker(const ShardPlan& plan, const EngineOptions& options, std::vector<Socket>& peers)
+        : plan_(plan), peers_(peers), engine_(plan.num_leaf, plan.steps, options),
+          batch_size_(static_cast<std::size_t>(options.insert_batch)), router_(plan.shards, plan.approx_cutoff) {
+        for (std::uint32_t peer = 0; peer < plan_.shards; ++peer) {
+            outgoing_.push_back(engine_.make_table());
+        }
+        // Every worker builds the initial config; only its owner keeps it
+        Config initial = make_config({{plan_.num_leaf, 1}});
+        std::uint64_t hash = FrontierTable::hash_config(initial.data(), initial.size());
+        if (router_.owner(initial.data(), initial.size(), hash) != plan_.id) {
+            FrontierTable empty = engine_.make_table();
+            engine_.replace_frontier(empty, 0);
+        }
+    }
+
+    std::size_t shard_size() const { return engine_.frontier_size(); }
+
+    // Expands the local shard by picks, exchanging successors with the other shards
+    void step(int picks) {
+        FrontierTable next = engine_.make_table(engine_.frontier_size());
+        std::vector<std::vector<unsigned char>> received;
+        std::exception_ptr receive_error;
+        std::thread receiver([&] {
+            try {
+                receive_batches(received);
+            } catch (...) {
+                receive_error = std::current_exception();
+            }
+        });
+
+        try {
+            BatchedInserter local(next, batch_size_);
+            auto route = [&](const StepEngine::Entry* config, std::size_t len, double prob) {
+                std::uint64_t hash = FrontierTable::hash_config(config, len);
+                std::uint32_t owner = router_.owner(config, len, hash);
+                if (owner == plan_.id) {
+                    local.add(config, len, prob);
+                    return;
+                }
+                // Combining before sending shrinks batches: successors repeat a lot
+                outgoing_[owner].add_hashed(hash, config, len, prob);
+                if (outgoing_[owner].size() >= plan_.batch_configs) {
+                    send_batch(owner);
+                }
+            };
+            if (picks == 2) {
+                engine_.reduce_next_two(route);
+            } else {
+                engine_.reduce_next(route);
+            }
+            local.flush();
+            for (std::uint32_t peer = 0; peer < plan_.shards; ++peer) {
+                if (peer == plan_.id) continue;
+                if (outgoing_[peer].size() > 0) {
+                    send_batch(peer);
+                }
+                send_message(peers_[peer], MessageType::End);
+            }
+        } catch (...) {
+            // Wake the receiver so it can be joined
+            for (Socket& peer : peers_) {
+                peer.shutdown();
+            }
+            receiver.join();
+            throw;
+        }
+
+        auto wait_start = std::chrono::steady_clock::now();
+        receiver.join();
+        telemetry().net_barrier_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - wait_start).count();
+        if (receive_error) {
+            std::rethrow_exception(receive_error);
+        }
+
+        {
+            BatchedInserter remote(next, batch_size_);
+            for (const std::vector<unsigned char>& batch : received) {
+                // Bounded by the payload, so a truncated or corrupt Batch throws instead of reading past it
+                decode_frontier(batch.data(), batch.data() + batch.size(),
+                                [&](const StepEngine::Entry* config, std::size_t len, double prob) {
+                                    remote.add(config, len, prob);
+                                });
+            }
+            remote.flush();
+        }
+        engine_.replace_frontier(next, picks);
+    }
+
+    // Reduces the final picks of the local shard into a histogram
+    Histogram reduce(int picks) {
+        PnodeHistogram pnodes;
+        auto add = [&](const StepEngine::Entry* config, std::size_t len, double prob) {
+            pnodes.add(config, len, prob);
+        };
+        if (picks == 2) {
+            engine_.reduce_next_two(add);
+        } else if (picks == 1) {
+            engine_.reduce_next(add);
+        } else {
+            engine_.for_each_config(add);
+        }
+        return pnodes.result();
+    }
+
+private:
+    void send_batch(std::uint32_t peer) {
+        Telemetry& stats = telemetry();
+        buffer_.clear();
+        encode_frontier(outgoing_[peer], buffer_);
+        send_message(peers_[peer], MessageType::Batch, buffer_);
+        stats.net_batches_sent += 1;
+        stats.net_configs_sent += static_cast<long long>(outgoing_[peer].size());
+        outgoing_[peer] = engine_.make_table();
+    }
+
+    // Collects Batch payloads until every peer has sent End
+    void receive_batches(std::vector<std::vector<unsigned char>>& received) {
+        std::vector<pollfd> open;
+        std::vector<std::uint32_t> open_peers;
+        for (std::uint32_t peer = 0; peer < plan_.shards; ++peer) {
+            if (peer != plan_.id) {
+                open.push_back({peers_[peer].fd(), POLLIN, 0});
+                open_peers.push_back(peer);
+            }
+        }
+        std::vector<unsigned char> payload;
+        while (!open.empty()) {
+            if (poll(open.data(), open.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("poll failed");
+            }
+            for (std::size_t i = 0; i < open.size();) {
+                if (open[i].revents == 0) {
+                    ++i;
+                    continue;
+                }
+                open[i].revents = 0;
+                // Messages are sent whole, so reading a complete one only blocks briefly
+                MessageType type = recv_message(peers_[open_peers[i]], payload);
+                if (type == MessageType::Batch) {
+                    received.push_back(std::move(payload));
+                    payload = std::vector<unsigned char>();
+                    ++i;
+                } else if (type == MessageType::End) {
+                    open.erase(open.begin() + static_cast<std::ptrdiff_t>(i));
+                    open_peers.erase(open_peers.begin() + static_cast<std::ptrdiff_t>(i));
+                } else {
+                    throw std::runtime_error("Unexpected message from shard " + std::to_string(open_peers[i]));
+                }
+            }
+        }
+    }
+
+    ShardPlan plan_;
+    std::vector<Socket>& peers_;
+    StepEngine engine_;
+    std::vector<FrontierTable> outgoing_; // Combined transitions per destination shard
+    std::vector<unsigned char> buffer_;
+    std::size_t batch_size_;
+    ShardRouter router_;
+};
+
+} // namespace
+
+void run_shard_worker(const std::string& host, int port) {
+    Socket coordinator = connect_tcp(host, port);
+    // Peers reach this worker on the interface it reached the coordinator through
+    Socket listener = listen_tcp(local_address(coordinator), 0);
+
+    std::vector<unsigned char> payload;
+    put(payload, static_cast<std::uint32_t>(local_port(listener)));
+    send_message(coordinator, MessageType::Hello, payload);
+
+    expect_message(coordinator, MessageType::Peers, payload);
+    PayloadReader reader(payload);
+    ShardPlan plan = reader.get<ShardPlan>();
+    std::vector<PeerAddress> addresses(plan.shards);
+    for (PeerAddress& address : addresses) {
+        address.host = reader.get_string();
+        address.port = static_cast<int>(reader.get<std::uint32_t>());
+    }
+
+    // Full mesh: connect to every lower id, accept every higher one. Connects complete
+    // in the listen backlog, so the order cannot deadlock.
+    std::vector<Socket> peers(plan.shards);
+    for (std::uint32_t peer = 0; peer < plan.id; ++peer) {
+        peers[peer] = connect_tcp(addresses[peer].host, addresses[peer].port);
+        payload.clear();
+        put(payload, plan.id);
+        send_message(peers[peer], MessageType::Hello, payload);
+    }
+    for (std::uint32_t accepted = plan.id + 1; accepted < plan.shards; ++accepted) {
+        Socket socket = accept_tcp(listener);
+        expect_message(socket, MessageType::Hello, payload);
+        std::uint32_t peer = PayloadReader(payload).get<std::uint32_t>();
+        if (peer <= plan.id || peer >= plan.shards || peers[peer].valid()) {
+            throw std::runtime_error("Bad shard id " + std::to_string(peer) + " from peer");
+        }
+        peers[peer] = std::move(socket);
+    }
+    listener.reset();
+
+    EngineOptions options;
+    options.hugepages = static_cast<HugePagePolicy>(plan.hugepages);
+    options.insert_batch = plan.insert_batch;
+    options.approx_cutoff = plan.approx_cutoff;
+    options.compress_frontier = plan.compress_frontier != 0;
+    options.max_load_percent = plan.max_load_percent;
+    options.arena_block_bytes = static_cast<std::size_t>(plan.arena_block_bytes);
+    ShardWorker worker(plan, options, peers);
+
+    while (true) {
+        MessageType type = recv_message(coordinator, payload);
+        if (type == MessageType::Step) {
+            worker.step(static_cast<int>(PayloadReader(payload).get<std::uint32_t>()));
+            payload.clear();
+            put(payload, static_cast<std::uint64_t>(worker.shard_size()));
+            send_message(coordinator, MessageType::Done, payload);
+        } else if (type == MessageType::Reduce) {
+            Histogram hist = worker.reduce(static_cast<int>(PayloadReader(payload).get<std::uint32_t>()));
+            payload.clear();
+            put(payload, static_cast<std::uint64_t>(hist.size()));
+            for (const auto& [value, prob] : hist) {
+                put(payload, static_cast<std::int32_t>(value));
+                put(payload, prob);
+            }
+            send_message(coordinator, MessageType::Hist, payload);
+        } else if (type == MessageType::Quit) {
+            break;
+        } else {
+            throw std::runtime_error("Unexpected message from coordinator");
+        }
+    }
+
+    std::ostringstream report;
+    print_telemetry(report);
+    std::istringstream lines(report.str());
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::cerr << "[shard " << plan.id << "] " << line << std::endl;
+    }
+}
+
+Histogram sample_sharded(int num_leaf, int steps, const ShardOptions& shard_options, const EngineOptions& options) {
+    if (num_leaf <= 0 || steps < 0) {
+        return {};
+    }
+    if (shard_options.shards < 1) {
+        throw std::invalid_argument("Need at least one shard");
+    }
+    if (!options.checkpoint_path.empty() || !options.resume_path.empty()) {
+        throw std::invalid_argument("Checkpoints are not supported with shards");
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    Socket listener = listen_tcp(shard_options.listen_host, shard_options.listen_port);
+    int port = local_port(listener);
+    std::cerr << "Coordinator listening on " << shard_options.listen_host << ":" << port
+              << " for " << shard_options.shards << " workers" << std::endl;
+
+    ChildProcesses children;
+    if (shard_options.spawn_workers) {
+        // Workers are exec'd, not run in the forked child: this process may already run threads
+        // (--metrics-file writer, queue lease heartbeat) whose malloc or stream locks the child
+        // would inherit held. Only async-signal-safe calls happen between fork and exec.
+        std::string binary = shard_options.worker_binary;
+        std::string flag = "--worker";
+        std::string address = shard_options.listen_host + ":" + std::to_string(port);
+        char* args[] = {binary.data(), flag.data(), address.data(), nullptr};
+        std::cout.flush();
+        std::cerr.flush();
+        for (int i = 0; i < shard_options.shards; ++i) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                throw std::runtime_error("fork failed");
+            }
+            if (pid == 0) {
+                execv(args[0], args);
+                _exit(127);
+            }
+            children.add(pid);
+        }
+    }
+
+    std::vector<Socket> workers;
+    std::vector<PeerAddress> addresses;
+    std::vector<unsigned char> payload;
+    for (int i = 0; i < shard_options.shards; ++i) {
+        workers.push_back(accept_tcp(listener));
+        expect_message(workers.back(), MessageType::Hello, payload);
+        addresses.push_back({remote_address(workers.back()),
+                             static_cast<int>(PayloadReader(payload).get<std::uint32_t>())});
+    }
+    listener.reset();
+
+    for (int i = 0; i < shard_options.shards; ++i) {
+        // Sent as raw bytes, so the padding is zeroed too
+        ShardPlan plan;
+        std::memset(&plan, 0, sizeof(plan));
+        plan.id = static_cast<std::uint32_t>(i);
+        plan.shards = static_cast<std::uint32_t>(shard_options.shards);
+        plan.num_leaf = num_leaf;
+        plan.steps = steps;
+        plan.insert_batch = options.insert_batch;
+        plan.approx_cutoff = options.approx_cutoff;
+        plan.hugepages = static_cast<std::uint8_t>(options.hugepages);
+        plan.compress_frontier = static_cast<std::uint8_t>(options.compress_frontier ? 1 : 0);
+        plan.batch_configs = static_cast<std::uint64_t>(std::max<std::size_t>(1, shard_options.batch_configs));
+        plan.max_load_percent = options.max_load_percent;
+        plan.arena_block_bytes = static_cast<std::uint64_t>(options.arena_block_bytes);
+        payload.clear();
+        put(payload, plan);
+        for (const PeerAddress& address : addresses) {
+            put_string(payload, address.host);
+            put(payload, static_cast<std::uint32_t>(address.port));
+        }
+        send_message(workers[i], MessageType::Peers, payload);
+    }
+
+    // Same schedule as sample_reduce
+    auto broadcast = [&](MessageType type, int picks) {
+        payload.clear();
+        put(payload, static_cast<std::uint32_t>(picks));
+        for (const Socket& worker : workers) {
+            send_message(worker, type, payload);
+        }
+    };
+    int done = 0;
+    auto run_step = [&](int picks) {
+        auto start = std::chrono::steady_clock::now();
+        broadcast(MessageType::Step, picks);
+        std::size_t total = 0;
+        std::size_t largest = 0;
+        for (const Socket& worker : workers) {
+            expect_message(worker, MessageType::Done, payload);
+            std::size_t shard_size = static_cast<std::size_t>(PayloadReader(payload).get<std::uint64_t>());
+            total += shard_size;
+            largest = std::max(largest, shard_size);
+        }
+        update_peak(telemetry().frontier_peak, static_cast<long long>(total));
+        std::cerr << "Sharded frontier: " << total << " configs, largest shard " << largest << std::endl;
+        record_step(done + picks, steps, total, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        return picks;
+    };
+    while (steps - done > scheduled_picks(steps - done, options.fuse_two_picks)) {
+        done += run_step(scheduled_picks(steps - done, options.fuse_two_picks));
+    }
+
+    broadcast(MessageType::Reduce, steps - done);
+    std::map<int, double> merged;
+    for (const Socket& worker : workers) {
+        expect_message(worker, MessageType::Hist, payload);
+        PayloadReader reader(payload);
+        std::uint64_t count = reader.get<std::uint64_t>();
+        for (std::uint64_t i = 0; i < count; ++i) {
+            int value = reader.get<std::int32_t>();
+            merged[value] += reader.get<double>();
+        }
+    }
+    for (const Socket& worker : workers) {
+        send_message(worker, MessageType::Quit);
+    }
+    children.wait_all();
+
+    std::cerr << "Total sharded execution time: "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms" << std::endl;
+    return Histogram(merged.begin(), merged.end());
+}
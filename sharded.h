@@ -0,0 +1,54 @@
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include "sampler.h"    // For EngineOptions
+#include "tree_utils.h" // For Histogram
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Layout of a sharded run.
+ */
+struct ShardOptions {
+    int shards = 2;                          // Number of worker processes holding frontier shards
+    std::string listen_host = "127.0.0.1";   // Address the coordinator accepts workers on
+    int listen_port = 0;                     // 0 picks a free port
+    bool spawn_workers = true;               // Start local workers; otherwise wait for `--worker HOST:PORT` processes
+    std::size_t batch_configs = 1 << 16;     // Remote transitions combined per destination before a batch is sent
+    std::string worker_binary = "/proc/self/exe"; // Executable spawned as `worker_binary --worker HOST:PORT`
+};
+
+/**
+ * @brief Runs sample_reduce with a PnodeHistogram over frontier shards held by separate processes.
+ *
+ * Every config is owned by one shard, chosen by its hash (by the hash of its coarse
+ * signature with approx_cutoff, so coarsening groups stay together), so each worker holds
+ * roughly 1/shards of every frontier. Per step, a worker expands its shard
+ * through StepEngine::reduce_next; successors it owns go straight into its next
+ * table, the others are combined in a small table per destination and sent as
+ * encode_frontier batches. Each worker ends its step with an End message to every
+ * peer and a Done message to the coordinator, which starts the next step once all
+ * workers are done (the barrier). The final step is reduced locally by every worker
+ * and the coordinator adds up their histograms.
+ *
+ * Workers connect to each other directly (a full mesh), so the coordinator only
+ * carries control messages. The wire format is native-endian: all hosts must share
+ * the same architecture. checkpoint_path and resume_path are not supported.
+ * @param num_leaf The initial number of leaves.
+ * @param steps The number of sampling steps to perform.
+ * @param shard_options Number of shards and how workers are found.
+ * @param options Engine tuning knobs, forwarded to every worker.
+ * @return The distribution of the number of revealed nodes, as PnodeHistogram::result().
+ */
+Histogram sample_sharded(int num_leaf, int steps, const ShardOptions& shard_options,
+                         const EngineOptions& options = EngineOptions());
+
+/**
+ * @brief Runs one worker of sample_sharded until the coordinator at host:port says Quit.
+ *
+ * Throws std::runtime_error if the coordinator or a peer goes away.
+ */
+void run_shard_worker(const std::string& host, int port);
+
+#endif // SHARDED_H
@@ -0,0 +1,48 @@
+// Microbenchmark for SplitTable construction.
+//
+// Builds the split table of every (csp, tau) parameter set whose tree fits an int
+// and reports the fastest and median build time over repeated runs, so short
+// queries can check the table is not a noticeable part of their startup.
+
+#include "split_table.h"
+#include "tree_utils.h" // For _vc_param
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    using namespace std::chrono;
+    int csp = argc > 1 ? std::atoi(argv[1]) : 256;
+    int repeats = argc > 2 ? std::max(1, std::atoi(argv[2])) : 101;
+
+    std::cout << "csp = " << csp << " repeats = " << repeats << std::endl;
+    std::cout << "tau,num_leaf,sizes,outcomes,min_us,median_us" << std::endl;
+    double worst_us = 0.0;
+    std::vector<double> times(static_cast<std::size_t>(repeats));
+    for (int tau = 1; tau <= csp; ++tau) {
+        auto [t0, k0, t1, k1] = _vc_param(csp, tau);
+        if (k0 >= 62) continue;
+        long long num_leaf = (1LL << k0) * t0 + (1LL << k1) * t1;
+        if (num_leaf > std::numeric_limits<int>::max()) continue; // Subtree sizes are ints
+
+        std::size_t sizes = 0, outcomes = 0;
+        for (double& us : times) {
+            auto start = steady_clock::now();
+            SplitTable table(static_cast<int>(num_leaf));
+            us = duration<double, std::micro>(steady_clock::now() - start).count();
+            sizes = table.num_sizes();
+            outcomes = table.num_outcomes();
+        }
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        worst_us = std::max(worst_us, median);
+        std::cout << tau << "," << num_leaf << "," << sizes << "," << outcomes << ","
+                  << times.front() << "," << median << std::endl;
+    }
+    std::cout << "worst median: " << worst_us << " us" << std::endl;
+    return 0;
+}
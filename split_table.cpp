@@ -0,0 +1,145 @@
+#include "split_table.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+inline bool is_power_of_two(long long n) {
+    return (n & (n - 1)) == 0;
+}
+
+inline int floor_log2(long long n) {
+    return 63 - __builtin_clzll(static_cast<unsigned long long>(n));
+}
+
+// Leaf counts of the two children of a non-full subtree, as sample_once splits it
+std::pair<long long, long long> child_sizes(long long n) {
+    int left_depth = floor_log2(2 * n - 1);
+    int right_depth = floor_log2(n);
+    long long num_shallow = (1LL << left_depth) - n;
+    if (num_shallow <= (1LL << (right_depth - 1))) {
+        long long left = 1LL << (left_depth - 1); // Left child is full
+        return {left, n - left};
+    }
+    long long right = 1LL << (right_depth - 1); // Right child is full
+    return {n - right, right};
+}
+
+} // namespace
+
+SplitTable::SplitTable(int num_leaf) {
+    if (num_leaf <= 0) {
+        throw std::invalid_argument("SplitTable needs a positive number of leaves");
+    }
+    // The non-full sizes form a chain down from num_leaf; every full subtree below
+    // a power of two 2^d splits into 1, 2, ..., 2^(d-1)
+    long long n = num_leaf;
+    long long largest_full = 1;
+    while (!is_power_of_two(n)) {
+        sizes_.push_back(static_cast<int>(n));
+        auto [left, right] = child_sizes(n);
+        largest_full = std::max(largest_full, is_power_of_two(left) ? left : right);
+        n = is_power_of_two(left) ? right : left;
+    }
+    largest_full = std::max(largest_full, n);
+    for (long long full = 1; full <= largest_full; full *= 2) {
+        sizes_.push_back(static_cast<int>(full));
+    }
+    std::sort(sizes_.begin(), sizes_.end());
+    sizes_.erase(std::unique(sizes_.begin(), sizes_.end()), sizes_.end());
+
+    // Pieces are addressed by offset while the buffers grow, and turned into pointers at the end
+    std::vector<std::size_t> piece_offset;
+    std::vector<Entry> candidate_pieces;
+    std::vector<std::size_t> candidate_offset;
+    std::vector<double> candidate_prob;
+    std::vector<std::size_t> order;
+    first_outcome_.reserve(sizes_.size() + 1);
+
+    for (std::size_t index = 0; index < sizes_.size(); ++index) {
+        long long size = sizes_[index];
+        first_outcome_.push_back(outcomes_.size());
+        if (is_power_of_two(size)) {
+            piece_offset.push_back(pieces_.size());
+            for (long long piece = 1; piece < size; piece *= 2) {
+                pieces_.push_back({static_cast<int>(piece), 1});
+            }
+            outcomes_.push_back({nullptr, pieces_.size() - piece_offset.back(), 1.0});
+            continue;
+        }
+
+        // Each child's outcomes with the sibling subtree added, left child first
+        candidate_pieces.clear();
+        candidate_offset.assign(1, 0);
+        candidate_prob.clear();
+        auto [left, right] = child_sizes(size);
+        for (long long child : {left, right}) {
+            int rest = static_cast<int>(size - child);
+            double child_prob = static_cast<double>(child) / static_cast<double>(size);
+            std::size_t child_index = static_cast<std::size_t>(
+                std::lower_bound(sizes_.begin(), sizes_.end(), static_cast<int>(child)) - sizes_.begin());
+            for (std::size_t o = first_outcome_[child_index]; o < first_outcome_[child_index + 1]; ++o) {
+                const Entry* pieces = pieces_.data() + piece_offset[o];
+                std::size_t len = outcomes_[o].len;
+                std::size_t at = static_cast<std::size_t>(
+                    std::lower_bound(pieces, pieces + len, Entry{rest, 0}) - pieces);
+                candidate_pieces.insert(candidate_pieces.end(), pieces, pieces + at);
+                if (at < len && pieces[at].first == rest) {
+                    candidate_pieces.push_back({rest, pieces[at].second + 1});
+                    ++at;
+                } else {
+                    candidate_pieces.push_back({rest, 1});
+                }
+                candidate_pieces.insert(candidate_pieces.end(), pieces + at, pieces + len);
+                candidate_offset.push_back(candidate_pieces.size());
+                candidate_prob.push_back(child_prob * outcomes_[o].prob);
+            }
+        }
+
+        // Sort and merge like a std::map<Config, double> would
+        order.resize(candidate_prob.size());
+        std::iota(order.begin(), order.end(), 0);
+        auto less = [&](std::size_t a, std::size_t b) {
+            return std::lexicographical_compare(
+                candidate_pieces.begin() + candidate_offset[a], candidate_pieces.begin() + candidate_offset[a + 1],
+                candidate_pieces.begin() + candidate_offset[b], candidate_pieces.begin() + candidate_offset[b + 1]);
+        };
+        std::stable_sort(order.begin(), order.end(), less);
+        for (std::size_t k = 0; k < order.size(); ++k) {
+            std::size_t c = order[k];
+            if (k > 0 && !less(order[k - 1], c)) {
+                outcomes_.back().prob += candidate_prob[c]; // Same pieces as the previous outcome
+                continue;
+            }
+            piece_offset.push_back(pieces_.size());
+            pieces_.insert(pieces_.end(), candidate_pieces.begin() + candidate_offset[c],
+                           candidate_pieces.begin() + candidate_offset[c + 1]);
+            outcomes_.push_back({nullptr, candidate_offset[c + 1] - candidate_offset[c], candidate_prob[c]});
+        }
+    }
+    first_outcome_.push_back(outcomes_.size());
+
+    for (std::size_t o = 0; o < outcomes_.size(); ++o) {
+        outcomes_[o].pieces = pieces_.data() + piece_offset[o];
+    }
+}
+
+SplitTable::Outcomes SplitTable::outcomes(int subtree_size) const {
+    auto it = std::lower_bound(sizes_.begin(), sizes_.end(), subtree_size);
+    if (it == sizes_.end() || *it != subtree_size) {
+        throw std::out_of_range("No split outcomes for subtree size " + std::to_string(subtree_size));
+    }
+    std::size_t index = static_cast<std::size_t>(it - sizes_.begin());
+    return {outcomes_.data() + first_outcome_[index], outcomes_.data() + first_outcome_[index + 1]};
+}
+
+Distribution SplitTable::distribution(int subtree_size) const {
+    Distribution dist;
+    for (const SplitOutcome& outcome : outcomes(subtree_size)) {
+        dist.emplace_hint(dist.end(), Config(outcome.pieces, outcome.pieces + outcome.len), outcome.prob);
+    }
+    return dist;
+}
@@ -0,0 +1,86 @@
+#ifndef SPLIT_TABLE_H
+#define SPLIT_TABLE_H
+
+#include "tree_utils.h" // For Config, Distribution
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief One outcome of picking a uniform leaf in a subtree: the pieces left behind.
+ */
+struct SplitOutcome {
+    const std::pair<int, int>* pieces; // Sorted (subtree_size, count) pairs
+    std::size_t len;
+    double prob;
+};
+
+/**
+ * @brief Split outcomes of every subtree size reachable from a tree of num_leaf leaves.
+ *
+ * Subtree sizes form a small universe: each non-full subtree has one full child, so
+ * there is one non-full size per level plus the powers of two, at most about
+ * 2 log2(num_leaf) sizes. The table is built bottom-up in ascending size order: the
+ * outcomes of a size are those of its two children with the sibling added, so each
+ * size only reads sizes already built. Outcomes are kept in flat arrays, ordered and
+ * merged exactly as sample_once's Distribution would be. Sizes are computed in 64-bit,
+ * so any num_leaf that fits an int works.
+ */
+class SplitTable {
+public:
+    using Entry = std::pair<int, int>;
+
+    /**
+     * @brief An outcome range, iterable with range-for.
+     */
+    struct Outcomes {
+        const SplitOutcome* first;
+        const SplitOutcome* last;
+        const SplitOutcome* begin() const { return first; }
+        const SplitOutcome* end() const { return last; }
+        std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    };
+
+    explicit SplitTable(int num_leaf = 1);
+
+    SplitTable(SplitTable&&) noexcept = default;
+    SplitTable& operator=(SplitTable&&) noexcept = default;
+    SplitTable(const SplitTable&) = delete; // Outcomes point into pieces_
+    SplitTable& operator=(const SplitTable&) = delete;
+
+    /**
+     * @brief Outcomes of one pick in a subtree of the given size.
+     *
+     * Throws std::out_of_range if the size is not a subtree size of the tree.
+     */
+    Outcomes outcomes(int subtree_size) const;
+
+    /**
+     * @brief The outcomes of one size as a Distribution (as sample_once returns it).
+     */
+    Distribution distribution(int subtree_size) const;
+
+    /**
+     * @brief Number of distinct subtree sizes held.
+     */
+    std::size_t num_sizes() const { return sizes_.size(); }
+
+    /**
+     * @brief The subtree sizes held, ascending.
+     */
+    const std::vector<int>& sizes() const { return sizes_; }
+
+    /**
+     * @brief Total number of outcomes over all sizes.
+     */
+    std::size_t num_outcomes() const { return outcomes_.size(); }
+
+private:
+    std::vector<int> sizes_;                // Ascending
+    std::vector<std::size_t> first_outcome_; // Per size, plus one past the end
+    std::vector<SplitOutcome> outcomes_;
+    std::vector<Entry> pieces_;
+};
+
+#endif // SPLIT_TABLE_H
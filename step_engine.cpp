@@ -0,0 +1,419 @@
+#include "step_engine.h"
+#include "checkpoint.h" // For AsyncCheckpointWriter, load_checkpoint
+#include "approx.h"     // For coarsen_frontier
+#include "pipeline.h"   // For TransitionPipeline
+
+#include <algorithm> // For std::minmax
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+
+StepEngine::StepEngine(int num_leaf, int steps, const EngineOptions& options)
+    : num_leaf_(num_leaf), steps_(steps), options_(options),
+      layout_{options.max_load_percent, options.arena_block_bytes, options.hugepages},
+      table_(0, layout_), start_(std::chrono::high_resolution_clock::now()) {
+
+    splits_ = SplitTable(num_leaf_);
+    split_table_time_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start_).count();
+
+    if (!options_.resume_path.empty()) {
+        int saved_leaf = 0;
+        load_checkpoint(options_.resume_path, saved_leaf, step_, table_);
+        if (saved_leaf != num_leaf_ || step_ > steps_) {
+            throw std::invalid_argument("Checkpoint " + options_.resume_path + " does not match num_leaf/steps");
+        }
+        std::cerr << "Resumed from " << options_.resume_path << " at step " << step_ << std::endl;
+    } else {
+        // Initial distribution: starts with one tree of size num_leaf
+        table_.add(make_config({{num_leaf_, 1}}), 1.0);
+    }
+
+    if (options_.pipeline_expanders > 0 || options_.pipeline_aggregators > 0) {
+        if (options_.pipeline_expanders < 1 || options_.pipeline_aggregators < 1) {
+            throw std::invalid_argument("The pipeline needs at least one expander and one aggregator thread");
+        }
+        if (options_.fuse_two_picks || options_.approx_cutoff > 0 || options_.compress_frontier) {
+            throw std::invalid_argument("The pipeline cannot be combined with --fuse2, --approx-cutoff "
+                                        "or --compress-frontier");
+        }
+        pipeline_ = std::make_unique<TransitionPipeline>(options_.pipeline_expanders, options_.pipeline_aggregators,
+                                                         static_cast<std::size_t>(options_.insert_batch));
+    }
+
+    // Checkpoints are written by a separate thread while the step expands the same frontier
+    if (!options_.checkpoint_path.empty()) {
+        checkpoint_ = std::make_unique<AsyncCheckpointWriter>();
+    }
+
+    Telemetry& stats = telemetry();
+    stats.current_step = step_;
+    stats.total_steps = steps_;
+    stats.frontier_size = static_cast<long long>(table_.size());
+    step_start_ = std::chrono::high_resolution_clock::now();
+}
+
+StepEngine::~StepEngine() = default;
+
+std::size_t StepEngine::frontier_size() const {
+    if (packed_) {
+        return packed_->size();
+    }
+    std::size_t size = table_.size();
+    for (const FrontierTable& part : parts_) {
+        size += part.size();
+    }
+    return size;
+}
+
+std::size_t StepEngine::current_bytes() const {
+    if (packed_) {
+        return packed_->memory_bytes();
+    }
+    std::size_t bytes = table_.memory_bytes();
+    for (const FrontierTable& part : parts_) {
+        bytes += part.memory_bytes();
+    }
+    return bytes;
+}
+
+const Distribution& StepEngine::split_two(int subtree_size) {
+    auto it = dp_two_.find(subtree_size);
+    if (it != dp_two_.end()) {
+        return it->second;
+    }
+    // First pick as in the split table; the second is uniform over the other subtree_size - 1
+    // leaves, i.e. over the pieces the first pick left behind
+    Distribution two;
+    Config combined;
+    if (subtree_size >= 2) {
+        for (const SplitOutcome& first : splits_.outcomes(subtree_size)) {
+            for (std::size_t j = 0; j < first.len; ++j) {
+                double piece_prob = first.prob * first.pieces[j].first * first.pieces[j].second / (subtree_size - 1.0);
+                for (const SplitOutcome& second : splits_.outcomes(first.pieces[j].first)) {
+                    apply_split(first.pieces, first.len, j, second.pieces, second.len, combined);
+                    two[combined] += piece_prob * second.prob;
+                }
+            }
+        }
+    }
+    return dp_two_.emplace(subtree_size, std::move(two)).first->second;
+}
+
+const Distribution& StepEngine::split_pair(int size_a, int size_b) {
+    std::pair<int, int> key = std::minmax(size_a, size_b);
+    auto it = dp_pair_.find(key);
+    if (it != dp_pair_.end()) {
+        return it->second;
+    }
+    // The two subtrees split independently
+    Distribution both;
+    Config pieces_a, pieces_b;
+    for (const SplitOutcome& a : splits_.outcomes(key.first)) {
+        pieces_a.assign(a.pieces, a.pieces + a.len);
+        for (const SplitOutcome& b : splits_.outcomes(key.second)) {
+            pieces_b.assign(b.pieces, b.pieces + b.len);
+            both[add_config(pieces_a, pieces_b)] += a.prob * b.prob;
+        }
+    }
+    return dp_pair_.emplace(key, std::move(both)).first->second;
+}
+
+void StepEngine::log_step(int picks) const {
+    // Optional: Print progress
+    if (options_.quiet) {
+        return;
+    }
+    if (picks == 2) {
+        std::cerr << step_ << "-th and " << step_ + 1 << "-th steps fused (out of " << steps_ << ")" << std::endl;
+    } else {
+        std::cerr << step_ << "-th step (out of " << steps_ << ")" << std::endl;
+    }
+}
+
+void StepEngine::begin_checkpoint() {
+    if (checkpoint_) {
+        checkpoint_->begin(options_.checkpoint_path, num_leaf_, step_, frontier_size());
+    }
+}
+
+void StepEngine::append_checkpoint(const Entry* config, std::size_t len, double prob) {
+    if (checkpoint_) {
+        checkpoint_->append(config, len, prob);
+    }
+}
+
+void StepEngine::finish_expansion() {
+    if (checkpoint_) {
+        checkpoint_->commit(); // fsync and rename happen while the next step runs
+    }
+}
+
+void StepEngine::end_step(int step, std::size_t frontier) {
+    auto now = std::chrono::high_resolution_clock::now();
+    record_step(step, steps_, frontier,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - step_start_).count());
+    step_start_ = now;
+}
+
+void StepEngine::set_control(const SampleControl* control) {
+    control_ = control;
+}
+
+void StepEngine::check_control() {
+    if (control_->progress) {
+        SampleProgress progress;
+        progress.step = step_;
+        progress.steps = steps_;
+        progress.configs_done = expanded_;
+        progress.configs_total = frontier_size();
+        progress.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_).count();
+        control_->progress(progress);
+    }
+    if ((control_->cancel != nullptr && control_->cancel->cancelled())
+        || std::chrono::steady_clock::now() >= control_->deadline) {
+        throw StepCancelled();
+    }
+}
+
+void StepEngine::drop_step() {
+    if (checkpoint_) {
+        checkpoint_->discard();
+    }
+    std::cerr << "Step " << step_ << " cancelled after " << expanded_ << " of " << frontier_size()
+              << " configs" << std::endl;
+}
+
+bool StepEngine::advance() {
+    if (pipeline_) {
+        return advance_pipelined();
+    }
+    log_step(1);
+
+    // Every config has at least one successor, so size the next table accordingly
+    FrontierTable next = make_table(frontier_size());
+    try {
+        BatchedInserter inserter(next, static_cast<std::size_t>(options_.insert_batch));
+        auto insert = [&](const Entry* config, std::size_t len, double prob) {
+            inserter.add(config, len, prob);
+        };
+        expand_all(insert);
+        inserter.flush();
+    } catch (const StepCancelled&) {
+        drop_step();
+        return false;
+    }
+    replace_frontier(next, 1);
+    return true;
+}
+
+bool StepEngine::advance_two() {
+    log_step(2);
+
+    FrontierTable next = make_table(frontier_size());
+    try {
+        BatchedInserter inserter(next, static_cast<std::size_t>(options_.insert_batch));
+        auto insert = [&](const Entry* config, std::size_t len, double prob) {
+            inserter.add(config, len, prob);
+        };
+        expand_all_two(insert);
+        inserter.flush();
+    } catch (const StepCancelled&) {
+        drop_step();
+        return false;
+    }
+    replace_frontier(next, 2);
+    return true;
+}
+
+void StepEngine::replace_frontier(FrontierTable& next, int picks) {
+    Telemetry& stats = telemetry();
+    finish_expansion();
+
+    if (options_.approx_cutoff > 0) {
+        next = coarsen_frontier(next, options_.approx_cutoff);
+    }
+
+    update_peak(stats.frontier_peak, static_cast<long long>(next.size()));
+    update_peak(stats.frontier_bytes_peak, static_cast<long long>(current_bytes() + next.memory_bytes()));
+    // Sample THP backing while both tables are still mapped
+    sample_hugepage_backing();
+
+    // Update the distribution for the next step
+    step_ += picks;
+    packed_.reset();
+    parts_.clear();
+    if (options_.compress_frontier && step_ < steps_) {
+        packed_ = std::make_unique<CompressedFrontier>(next);
+        if (!options_.quiet) {
+            std::cerr << "Compressed frontier: " << packed_->size() << " configs, "
+                      << next.memory_bytes() / 1048576.0 << " MB -> "
+                      << packed_->memory_bytes() / 1048576.0 << " MB ("
+                      << packed_->encoded_bytes() / 1048576.0 << " MB encoded)" << std::endl;
+        }
+        table_ = make_table(); // Release the uncompressed table
+    } else {
+        table_ = std::move(next);
+    }
+    end_step(step_, frontier_size());
+}
+
+std::vector<const FrontierTable*> StepEngine::current_tables() const {
+    std::vector<const FrontierTable*> tables;
+    if (parts_.empty()) {
+        tables.push_back(&table_);
+    }
+    for (const FrontierTable& part : parts_) {
+        tables.push_back(&part);
+    }
+    return tables;
+}
+
+bool StepEngine::begin_pipelined_step() {
+    begin_checkpoint();
+    if (control_ != nullptr) {
+        expanded_ = 0;
+        try {
+            check_control();
+        } catch (const StepCancelled&) {
+            drop_step();
+            return false;
+        }
+    }
+    return true;
+}
+
+void StepEngine::checkpoint_frontier() {
+    if (checkpoint_) {
+        for_each_config([&](const Entry* config, std::size_t len, double prob) {
+            append_checkpoint(config, len, prob);
+        });
+    }
+}
+
+bool StepEngine::poll_pipelined(const std::atomic<std::size_t>& expanded, std::size_t& reported) {
+    if (control_ == nullptr) {
+        return true;
+    }
+    expanded_ = expanded.load(std::memory_order_relaxed);
+    if (expanded_ / control_->chunk_configs == reported
+        && (control_->cancel == nullptr || !control_->cancel->cancelled())
+        && std::chrono::steady_clock::now() < control_->deadline) {
+        return true;
+    }
+    reported = expanded_ / control_->chunk_configs;
+    try {
+        check_control();
+    } catch (const StepCancelled&) {
+        return false;
+    }
+    return true;
+}
+
+bool StepEngine::advance_pipelined() {
+    log_step(1);
+    int remaining_leaves = num_leaf_ - step_;
+    Telemetry& stats = telemetry();
+    if (!begin_pipelined_step()) {
+        return false;
+    }
+
+    std::vector<const FrontierTable*> tables = current_tables();
+    std::atomic<std::size_t> expanded{0};
+    auto expand = [&](int expander, TransitionPipeline::Emitter& emit) {
+        Config scratch;
+        expand_share(tables, expander, pipeline_->expanders(), remaining_leaves, scratch, emit,
+                     [&] { return emit.stopped(); }, expanded);
+    };
+    // The checkpoint is written from this thread while the expanders read the same frontier
+    auto caller_work = [&] { checkpoint_frontier(); };
+    std::size_t reported = 0; // Chunks of control_->chunk_configs already passed to check_control()
+    auto poll = [&] { return poll_pipelined(expanded, reported); };
+
+    long long batches = stats.pipeline_batches;
+    long long queued = stats.pipeline_queued_batches;
+    long long expander_waits = stats.pipeline_expander_waits;
+    long long aggregator_waits = stats.pipeline_aggregator_waits;
+    std::vector<FrontierTable> next;
+    if (!pipeline_->run(frontier_size(), layout_, expand, caller_work, poll, next)) {
+        expanded_ = expanded.load(std::memory_order_relaxed);
+        drop_step();
+        return false;
+    }
+    batches = stats.pipeline_batches - batches;
+    if (!options_.quiet) {
+        std::cerr << "Pipeline: " << batches << " batches, mean lane fill "
+                  << (batches > 0 ? static_cast<double>(stats.pipeline_queued_batches - queued) / batches : 0.0)
+                  << " of " << TransitionPipeline::kLaneBatches << ", expander waits "
+                  << stats.pipeline_expander_waits - expander_waits << ", aggregator waits "
+                  << stats.pipeline_aggregator_waits - aggregator_waits << std::endl;
+    }
+    replace_frontier_parts(next);
+    return true;
+}
+
+int StepEngine::pipeline_threads() const {
+    return pipeline_ ? pipeline_->expanders() + pipeline_->aggregators() : 0;
+}
+
+bool StepEngine::run_pipelined_reduce(const std::function<void(int, const std::atomic<bool>&)>& work,
+                                      std::atomic<std::size_t>& expanded) {
+    std::size_t reported = 0;
+    if (!pipeline_->run_all(work, [&] { checkpoint_frontier(); },
+                            [&] { return poll_pipelined(expanded, reported); })) {
+        expanded_ = expanded.load(std::memory_order_relaxed);
+        drop_step();
+        return false;
+    }
+    finish_expansion();
+    end_step(step_ + 1, frontier_size());
+    return true;
+}
+
+void StepEngine::replace_frontier_parts(std::vector<FrontierTable>& next) {
+    Telemetry& stats = telemetry();
+    finish_expansion();
+
+    std::size_t next_size = 0, next_bytes = 0;
+    for (const FrontierTable& part : next) {
+        next_size += part.size();
+        next_bytes += part.memory_bytes();
+    }
+    update_peak(stats.frontier_peak, static_cast<long long>(next_size));
+    update_peak(stats.frontier_bytes_peak, static_cast<long long>(current_bytes() + next_bytes));
+    sample_hugepage_backing();
+
+    step_ += 1;
+    table_ = make_table();
+    parts_ = std::move(next);
+    end_step(step_, frontier_size());
+}
+
+Distribution StepEngine::to_distribution() const {
+    Distribution dist;
+    for_each_config([&](const Entry* config, std::size_t len, double prob) {
+        dist[Config(config, config + len)] += prob;
+    });
+    return dist;
+}
+
+void StepEngine::finish() {
+    if (checkpoint_) {
+        checkpoint_->wait();
+    }
+
+    if (options_.quiet) {
+        return;
+    }
+    using namespace std::chrono;
+    auto total_duration = duration_cast<microseconds>(high_resolution_clock::now() - start_);
+
+    std::cerr << "Total sample execution time: "
+              << total_duration.count() / 1000.0
+              << " ms" << std::endl;
+
+    std::cerr << "Split table construction time: "
+              << split_table_time_
+              << " us" << std::endl;
+    print_telemetry(std::cerr);
+}
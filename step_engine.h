@@ -0,0 +1,466 @@
+#ifndef STEP_ENGINE_H
+#define STEP_ENGINE_H
+
+#include "sampler.h"             // For EngineOptions, DpCache
+#include "split_table.h"         // For SplitTable
+#include "frontier.h"            // For FrontierTable
+#include "compressed_frontier.h" // For CompressedFrontier
+#include "telemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class AsyncCheckpointWriter;
+class TransitionPipeline;
+
+/**
+ * @brief Number of picks the next pass applies, with steps_left steps to go.
+ *
+ * Two with fuse_two_picks and an even number of steps left, otherwise one: with an
+ * odd number left the single pick goes first, while the frontier is small. Every
+ * entry point follows this schedule, so their passes end on the same steps and a
+ * checkpoint written by one lines up with the others.
+ */
+inline int scheduled_picks(int steps_left, bool fuse_two_picks) {
+    return fuse_two_picks && steps_left >= 2 && steps_left % 2 == 0 ? 2 : 1;
+}
+
+/**
+ * @brief The frontier-expansion loop behind sample(), one step at a time.
+ *
+ * Owns the current frontier (a FrontierTable, or a CompressedFrontier with
+ * options.compress_frontier), the split tables and the checkpoint writer.
+ * advance() materializes the next frontier; reduce_next() instead streams the
+ * transitions of the next step to a callback, which is how the final step feeds
+ * a reducer without building the final table. With options.pipeline_expanders and
+ * options.pipeline_aggregators, advance() runs on a TransitionPipeline and the
+ * frontier it produces is held as one FrontierTable per aggregator; the reduced final
+ * step runs on all the pipeline's threads (reduce_next_split).
+ */
+class StepEngine {
+public:
+    using Entry = FrontierTable::Entry;
+
+    /**
+     * @param num_leaf The initial number of leaves.
+     * @param steps Total number of steps the caller intends to run (for progress and compression).
+     * @param options Engine tuning knobs; options.resume_path loads a checkpoint.
+     */
+    StepEngine(int num_leaf, int steps, const EngineOptions& options);
+    ~StepEngine();
+    StepEngine(const StepEngine&) = delete;
+    StepEngine& operator=(const StepEngine&) = delete;
+
+    /**
+     * @brief Returns the number of steps applied to the current frontier.
+     */
+    int steps_done() const { return step_; }
+
+    /**
+     * @brief Returns the number of configs in the current frontier.
+     */
+    std::size_t frontier_size() const;
+
+    /**
+     * @brief Creates an empty table with this engine's hugepages, max load and arena block size.
+     */
+    FrontierTable make_table(std::size_t expected_size = 0) const { return FrontierTable(expected_size, layout_); }
+
+    /**
+     * @brief Checks control before every step and every control.chunk_configs expanded configs.
+     *
+     * A cancelled step is dropped: advance() and advance_two() return false and
+     * reduce_next() returns false, leaving the current frontier in place. control must
+     * outlive the engine or be reset with nullptr.
+     */
+    void set_control(const SampleControl* control);
+
+    /**
+     * @brief Applies one step, replacing the current frontier by its successors.
+     * @return False if the step was cancelled through set_control().
+     */
+    bool advance();
+
+    /**
+     * @brief Applies one step without materializing it.
+     *
+     * Calls fn(const Entry* config, std::size_t len, double prob) for every transition
+     * out of the current frontier. The same successor may be reported several times;
+     * its probabilities add up. The current frontier is left in place. Returns false
+     * if cancelled, in which case fn has seen only part of the transitions.
+     */
+    template <typename Fn>
+    bool reduce_next(Fn&& fn) {
+        log_step(1);
+        try {
+            expand_all(fn);
+        } catch (const StepCancelled&) {
+            drop_step();
+            return false;
+        }
+        finish_expansion();
+        end_step(step_ + 1, frontier_size());
+        return true;
+    }
+
+    /**
+     * @brief Applies two steps in a single pass, without the intermediate frontier.
+     *
+     * Uses the two-pick tables: both picks in one subtree of size n (split_two), or one
+     * pick in each of two subtrees of sizes a and b (split_pair).
+     */
+    bool advance_two();
+
+    /**
+     * @brief Two-pick counterpart of reduce_next.
+     */
+    template <typename Fn>
+    bool reduce_next_two(Fn&& fn) {
+        log_step(2);
+        try {
+            expand_all_two(fn);
+        } catch (const StepCancelled&) {
+            drop_step();
+            return false;
+        }
+        finish_expansion();
+        end_step(step_ + 2, frontier_size());
+        return true;
+    }
+
+    /**
+     * @brief Returns the picks of the next pass: scheduled_picks() for the steps left.
+     */
+    int next_picks() const { return scheduled_picks(steps_ - step_, options_.fuse_two_picks); }
+
+    /**
+     * @brief Applies the next pass of the schedule: advance_two() or advance().
+     */
+    bool advance_scheduled() { return next_picks() == 2 ? advance_two() : advance(); }
+
+    /**
+     * @brief Reduces the next pass of the schedule: reduce_next_two() or reduce_next().
+     */
+    template <typename Fn>
+    bool reduce_scheduled(Fn&& fn) {
+        return next_picks() == 2 ? reduce_next_two(fn) : reduce_next(fn);
+    }
+
+    /**
+     * @brief Returns the number of threads of the pipeline (expanders and aggregators), 0 without one.
+     */
+    int pipeline_threads() const;
+
+    /**
+     * @brief reduce_next() on every pipeline thread, each feeding its own reducer.
+     *
+     * The reduced step builds no frontier, so the aggregators expand too: thread t takes
+     * an equal share of the current slots and calls reducers[t].add(config, len, prob).
+     * Needs pipeline_threads() reducers. Returns false if cancelled, in which case the
+     * reducers have seen only part of the transitions.
+     */
+    template <typename Reducer>
+    bool reduce_next_split(std::vector<Reducer>& reducers) {
+        log_step(1);
+        if (!begin_pipelined_step()) {
+            return false;
+        }
+        std::vector<const FrontierTable*> tables = current_tables();
+        int remaining_leaves = num_leaf_ - step_;
+        int threads = static_cast<int>(reducers.size());
+        std::atomic<std::size_t> expanded{0};
+        auto work = [&](int thread, const std::atomic<bool>& stop) {
+            Config scratch;
+            auto add = [&](const Entry* config, std::size_t len, double prob) {
+                reducers[thread].add(config, len, prob);
+            };
+            expand_share(tables, thread, threads, remaining_leaves, scratch, add,
+                         [&] { return stop.load(std::memory_order_relaxed); }, expanded);
+        };
+        return run_pipelined_reduce(work, expanded);
+    }
+
+    /**
+     * @brief Reduces the next pass of the schedule into reducer.
+     *
+     * With a pipeline, the single-pick pass is spread over reduce_next_split() on copies
+     * of reducer emptied with clear(), which are then folded in with reducer.merge().
+     * reducer is left untouched if the pass is cancelled.
+     */
+    template <typename Reducer>
+    bool reduce_scheduled_into(Reducer& reducer) {
+        if (pipeline_ && next_picks() == 1) {
+            std::vector<Reducer> partial(static_cast<std::size_t>(pipeline_threads()), reducer);
+            for (Reducer& part : partial) {
+                part.clear();
+            }
+            if (!reduce_next_split(partial)) {
+                return false;
+            }
+            for (const Reducer& part : partial) {
+                reducer.merge(part);
+            }
+            return true;
+        }
+        auto add = [&](const Entry* config, std::size_t len, double prob) {
+            reducer.add(config, len, prob);
+        };
+        return reduce_scheduled(add);
+    }
+
+    /**
+     * @brief Installs next as the current frontier, picks steps after the current one.
+     *
+     * advance() and advance_two() end here; callers that build the next frontier
+     * themselves (the sharded engine, which merges transitions received from other
+     * processes) use it directly. Applies --approx-cutoff and compression like a
+     * regular step.
+     */
+    void replace_frontier(FrontierTable& next, int picks);
+
+    /**
+     * @brief Calls fn(const Entry* config, std::size_t len, double prob) for every current config.
+     */
+    template <typename Fn>
+    void for_each_config(Fn&& fn) const {
+        if (packed_) {
+            packed_->for_each(fn);
+        } else if (!parts_.empty()) {
+            for (const FrontierTable& part : parts_) {
+                part.for_each(fn);
+            }
+        } else {
+            table_.for_each(fn);
+        }
+    }
+
+    /**
+     * @brief Copies the current frontier into an ordered Distribution.
+     */
+    Distribution to_distribution() const;
+
+    /**
+     * @brief Waits for pending checkpoint I/O and prints timing and telemetry to stderr.
+     */
+    void finish();
+
+private:
+    // Passes the one-pick successors of a config to emit, building them in scratch; returns their number.
+    // Only reads the split table, so expander threads can share it.
+    template <typename Fn>
+    long long expand_config(const Entry* config, std::size_t len, double prob, int remaining_leaves,
+                            Config& scratch, Fn& emit) const {
+        long long transitions = 0;
+        for (std::size_t j = 0; j < len; ++j) {
+            int subtree_size = config[j].first;
+            int num_subtree = config[j].second; // Count of subtrees of this size
+            double subtree_prob = prob * (static_cast<double>(subtree_size) * num_subtree / remaining_leaves);
+            if (subtree_prob == 0) continue;
+
+            for (const SplitOutcome& outcome : splits_.outcomes(subtree_size)) {
+                // Decrease the count of the split subtree size and add the split result
+                apply_split(config, len, j, outcome.pieces, outcome.len, scratch);
+                emit(scratch.data(), scratch.size(), subtree_prob * outcome.prob);
+                ++transitions;
+            }
+        }
+        return transitions;
+    }
+
+    // Expands every current config, passing each successor to emit
+    template <typename Fn>
+    void expand_all(Fn& emit) {
+        int remaining_leaves = num_leaf_ - step_; // Remaining leaves after step_ splits
+        Telemetry& stats = telemetry();
+        begin_checkpoint();
+        if (control_ != nullptr) {
+            expanded_ = 0;
+            check_control();
+        }
+        for_each_config([&](const Entry* config, std::size_t len, double prob) {
+            poll_control();
+            append_checkpoint(config, len, prob);
+            long long transitions = expand_config(config, len, prob, remaining_leaves, scratch_, emit);
+            stats.transitions.fetch_add(transitions, std::memory_order_relaxed);
+        });
+    }
+
+    // Expands every current config by two picks at once
+    template <typename Fn>
+    void expand_all_two(Fn& emit) {
+        double remaining_leaves = num_leaf_ - step_;
+        double pick_pairs = remaining_leaves * (remaining_leaves - 1); // Ordered pairs of distinct leaves
+        Telemetry& stats = telemetry();
+        begin_checkpoint();
+        if (control_ != nullptr) {
+            expanded_ = 0;
+            check_control();
+        }
+        for_each_config([&](const Entry* config, std::size_t len, double prob) {
+            poll_control();
+            append_checkpoint(config, len, prob);
+            for (std::size_t j = 0; j < len; ++j) {
+                int subtree_size = config[j].first;
+                double size_j = subtree_size;
+                double num_j = config[j].second;
+
+                // Both picks land in the same subtree
+                double same_prob = prob * num_j * size_j * (size_j - 1) / pick_pairs;
+                if (same_prob != 0) {
+                    for (const auto& [split_config, split_prob] : split_two(subtree_size)) {
+                        apply_split(config, len, j, split_config, scratch_);
+                        emit(scratch_.data(), scratch_.size(), same_prob * split_prob);
+                        stats.transitions.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+
+                // The picks land in two different subtrees of the same size
+                double twin_prob = prob * num_j * (num_j - 1) * size_j * size_j / pick_pairs;
+                if (twin_prob != 0) {
+                    for (const auto& [split_config, split_prob] : split_pair(subtree_size, subtree_size)) {
+                        apply_double_split(config, len, j, j, split_config, scratch_);
+                        emit(scratch_.data(), scratch_.size(), twin_prob * split_prob);
+                        stats.transitions.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+
+                // One pick in a subtree of each of two different sizes, in either order
+                for (std::size_t k = j + 1; k < len; ++k) {
+                    double cross_prob = prob * 2 * num_j * size_j
+                                      * config[k].second * static_cast<double>(config[k].first) / pick_pairs;
+                    if (cross_prob == 0) continue;
+                    for (const auto& [split_config, split_prob] : split_pair(subtree_size, config[k].first)) {
+                        apply_double_split(config, len, j, k, split_config, scratch_);
+                        emit(scratch_.data(), scratch_.size(), cross_prob * split_prob);
+                        stats.transitions.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        });
+    }
+
+    // Expands share of shares equal ranges of the slots of tables, laid end to end; stops early once stopped()
+    template <typename Fn, typename Stopped>
+    void expand_share(const std::vector<const FrontierTable*>& tables, int share, int shares, int remaining_leaves,
+                      Config& scratch, Fn& emit, Stopped stopped, std::atomic<std::size_t>& expanded) const {
+        constexpr std::size_t kSlotChunk = 4096; // Slots between progress updates and stop checks
+        Telemetry& stats = telemetry();
+        std::size_t total_slots = 0;
+        for (const FrontierTable* table : tables) {
+            total_slots += table->slot_count();
+        }
+        std::size_t begin = total_slots * share / shares;
+        std::size_t end = total_slots * (share + 1) / shares;
+        std::size_t configs = 0;
+        long long transitions = 0;
+        auto visit = [&](const Entry* config, std::size_t len, double prob) {
+            transitions += expand_config(config, len, prob, remaining_leaves, scratch, emit);
+            ++configs;
+        };
+        std::size_t offset = 0; // Of the current table in the concatenated slot range
+        for (const FrontierTable* table : tables) {
+            std::size_t first = std::max(begin, offset);
+            std::size_t last = std::min(end, offset + table->slot_count());
+            for (std::size_t chunk = first; chunk < last && !stopped(); chunk += kSlotChunk) {
+                table->for_each_slot(chunk - offset, std::min(last, chunk + kSlotChunk) - offset, visit);
+                expanded.fetch_add(configs, std::memory_order_relaxed);
+                stats.transitions.fetch_add(transitions, std::memory_order_relaxed);
+                configs = 0;
+                transitions = 0;
+            }
+            offset += table->slot_count();
+        }
+    }
+
+    struct StepCancelled {}; // Thrown by check_control() to unwind a cancelled expansion
+
+    // Counts expanded configs; every control_->chunk_configs of them calls check_control()
+    void poll_control() {
+        if (control_ != nullptr && ++expanded_ % control_->chunk_configs == 0) {
+            check_control();
+        }
+    }
+    void check_control(); // Reports progress, throws StepCancelled if cancelled or past the deadline
+    void drop_step();     // Cleans up after StepCancelled
+
+    const Distribution& split_two(int subtree_size);
+    const Distribution& split_pair(int size_a, int size_b);
+    void log_step(int picks) const;
+    void begin_checkpoint();
+    void append_checkpoint(const Entry* config, std::size_t len, double prob);
+    void finish_expansion();
+    void end_step(int step, std::size_t frontier); // Reports the pass to telemetry (--metrics-file)
+    bool advance_pipelined();
+    std::vector<const FrontierTable*> current_tables() const; // table_, or parts_ after advance_pipelined
+    bool begin_pipelined_step(); // Starts the checkpoint and checks control; false if cancelled
+    void checkpoint_frontier();  // Appends the whole current frontier to the checkpoint
+    bool poll_pipelined(const std::atomic<std::size_t>& expanded, std::size_t& reported); // Pipeline poll()
+    bool run_pipelined_reduce(const std::function<void(int, const std::atomic<bool>&)>& work,
+                              std::atomic<std::size_t>& expanded); // Runs work on run_all, ends the step
+    void replace_frontier_parts(std::vector<FrontierTable>& next); // replace_frontier for advance_pipelined
+    std::size_t current_bytes() const; // Memory of the current frontier
+
+    int num_leaf_;
+    int steps_;
+    int step_ = 0;
+    EngineOptions options_;
+    FrontierLayout layout_; // From options_; passed to every table instead of the process-wide settings
+    SplitTable splits_; // One-pick split outcomes of every subtree size, built up front
+    DpCache dp_two_; // Outcomes of two picks in one subtree, by subtree size
+    std::map<std::pair<int, int>, Distribution> dp_pair_; // Outcomes of one pick in each of two subtrees
+    FrontierTable table_;
+    std::unique_ptr<CompressedFrontier> packed_; // Set when the current frontier is held compressed
+    std::vector<FrontierTable> parts_; // Current frontier by hash range, as left by advance_pipelined
+    std::unique_ptr<TransitionPipeline> pipeline_; // Set with options.pipeline_expanders
+    std::unique_ptr<AsyncCheckpointWriter> checkpoint_;
+    Config scratch_; // Successor being built, reused for every transition
+    long long split_table_time_ = 0;
+    std::chrono::high_resolution_clock::time_point start_;
+    std::chrono::high_resolution_clock::time_point step_start_; // End of the previous pass
+    const SampleControl* control_ = nullptr;
+    std::size_t expanded_ = 0; // Configs expanded in the current step, counted only with control_
+};
+
+/**
+ * @brief Runs the sampling process and feeds the final step to a reducer.
+ *
+ * The first steps - 1 steps materialize frontiers as in sample(); the transitions of
+ * the last step go straight to reducer.add(const Entry* config, std::size_t len, double prob),
+ * so the final Distribution is never built. Reducers are taken by template
+ * parameter, so the default path has no virtual calls. Zeroes the telemetry counters first.
+ * With options.pipeline_expanders the last step runs on all pipeline threads as well
+ * (see StepEngine::reduce_scheduled_into), which needs reducer.clear() and reducer.merge().
+ * @param num_leaf The initial number of leaves.
+ * @param steps The number of sampling steps to perform.
+ * @param reducer Receives the final configs with their probabilities.
+ * @param options Engine tuning knobs.
+ */
+template <typename Reducer>
+void sample_reduce(int num_leaf, int steps, Reducer& reducer, const EngineOptions& options = EngineOptions()) {
+    if (num_leaf <= 0 || steps < 0) {
+        return; // Nothing to reduce for invalid input
+    }
+    reset_telemetry();
+    StepEngine engine(num_leaf, steps, options);
+    auto add = [&](const StepEngine::Entry* config, std::size_t len, double prob) {
+        reducer.add(config, len, prob);
+    };
+    while (steps - engine.steps_done() > engine.next_picks()) {
+        engine.advance_scheduled();
+    }
+    if (engine.steps_done() < steps) {
+        engine.reduce_scheduled_into(reducer);
+    } else {
+        engine.for_each_config(add); // steps == 0, or resumed from the final frontier
+    }
+    engine.finish();
+}
+
+#endif // STEP_ENGINE_H
@@ -0,0 +1,324 @@
+#include "stratified.h"
+#include "monte_carlo.h" // For sample_monte_carlo (the plain baseline), splitmix64
+#include "reducers.h"    // For PnodeHistogram
+#include "sampler.h"     // For sample
+#include "split_table.h"
+#include "step_engine.h" // For sample_reduce
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Uniform in [0, 1) with 53 random bits
+inline double to_unit(std::uint64_t bits) {
+    return static_cast<double>(bits >> 11) * 0x1.0p-53;
+}
+
+struct Stratum {
+    Config config;
+    double weight;
+    std::uint64_t samples;
+};
+
+// The exact frontier after picks picks, with a proportional allocation of at least one sample each
+std::vector<Stratum> build_strata(int num_leaf, int picks, std::uint64_t samples) {
+    std::vector<Stratum> strata;
+    for (auto& [config, weight] : sample(num_leaf, picks)) {
+        if (weight <= 0) continue;
+        double share = weight * static_cast<double>(samples);
+        strata.push_back({config, weight, std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::llround(share)))});
+    }
+    return strata;
+}
+
+// Runs the remaining picks of one stratum, driven by 2 uniforms per pick. The config is
+// held as a count per subtree size of the split table, so a pick is a scan over at most
+// about 2 log2(num_leaf) sizes and a few count updates instead of a sorted merge.
+class ChainSampler {
+public:
+    explicit ChainSampler(const SplitTable& splits) : sizes_(splits.sizes()), counts_(sizes_.size(), 0) {
+        for (int size : sizes_) {
+            first_move_.push_back(moves_.size());
+            double cumulative = 0;
+            for (const SplitOutcome& outcome : splits.outcomes(size)) {
+                Move move{pieces_.size(), 0, cumulative += outcome.prob, -1};
+                for (std::size_t p = 0; p < outcome.len; ++p) {
+                    pieces_.push_back({index_of(outcome.pieces[p].first), outcome.pieces[p].second});
+                    move.added += outcome.pieces[p].second;
+                }
+                move.last_piece = pieces_.size();
+                moves_.push_back(move);
+            }
+        }
+        first_move_.push_back(moves_.size());
+    }
+
+    template <typename Uniform>
+    int run(const Config& start, int remaining, int picks, Uniform&& uniform) {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        int pnodes = 0;
+        for (const auto& [size, count] : start) {
+            counts_[index_of(size)] = count;
+            pnodes += count;
+        }
+        for (int pick = 0; pick < picks; ++pick, --remaining) {
+            // A subtree in proportion to its leaves
+            double target = uniform(2 * pick) * remaining;
+            std::size_t j = 0;
+            double cumulative = 0;
+            std::size_t last = 0;
+            for (; j < sizes_.size(); ++j) {
+                if (counts_[j] == 0) continue;
+                last = j;
+                cumulative += static_cast<double>(sizes_[j]) * counts_[j];
+                if (target < cumulative) break;
+            }
+            j = std::min(j, last); // Rounding at the top end
+            // One of its split outcomes
+            double u = uniform(2 * pick + 1);
+            std::size_t m = first_move_[j];
+            while (u >= moves_[m].cumulative && m + 1 < first_move_[j + 1]) {
+                ++m;
+            }
+            --counts_[j];
+            for (std::size_t p = moves_[m].first_piece; p < moves_[m].last_piece; ++p) {
+                counts_[pieces_[p].first] += pieces_[p].second;
+            }
+            pnodes += moves_[m].added;
+        }
+        return pnodes;
+    }
+
+private:
+    struct Move {
+        std::size_t first_piece;
+        std::size_t last_piece;
+        double cumulative; // Probability of this outcome and the ones before it
+        int added;         // Change of the number of revealed nodes
+    };
+
+    std::size_t index_of(int size) const {
+        return static_cast<std::size_t>(std::lower_bound(sizes_.begin(), sizes_.end(), size) - sizes_.begin());
+    }
+
+    std::vector<int> sizes_;
+    std::vector<std::size_t> first_move_;
+    std::vector<Move> moves_;
+    std::vector<std::pair<std::size_t, int>> pieces_; // (size index, count)
+    std::vector<int> counts_;
+};
+
+inline void tally(std::vector<std::uint64_t>& counts, int pnodes) {
+    if (static_cast<std::size_t>(pnodes) >= counts.size()) {
+        counts.resize(static_cast<std::size_t>(pnodes) + 1, 0);
+    }
+    ++counts[static_cast<std::size_t>(pnodes)];
+}
+
+// Generator of the Kronecker sequence in d dimensions: alpha_j = phi_d^-(j+1), where phi_d^(d+1) = phi_d + 1
+std::vector<double> kronecker_alpha(int dims) {
+    double phi = 2.0;
+    for (int i = 0; i < 64; ++i) {
+        phi = std::pow(1.0 + phi, 1.0 / (dims + 1));
+    }
+    std::vector<double> alpha(static_cast<std::size_t>(dims));
+    double power = 1.0;
+    for (double& a : alpha) {
+        power /= phi;
+        a = power - std::floor(power);
+    }
+    return alpha;
+}
+
+// Per-stratum tallies indexed by the number of revealed nodes, combined in stratum order so the result does not depend on the thread count
+std::vector<std::vector<std::uint64_t>> run_strata(int num_leaf, int tau, const std::vector<Stratum>& strata,
+                                                     int picks_done, const StratifiedOptions& options) {
+    SplitTable splits(num_leaf);
+    int picks = std::max(0, tau - picks_done);
+    int dims = 2 * picks;
+    std::vector<double> alpha = kronecker_alpha(std::max(dims, 1));
+    std::vector<std::vector<std::uint64_t>> tallies(strata.size());
+
+    std::size_t num_threads = static_cast<std::size_t>(std::max(1, options.threads));
+    num_threads = std::min(num_threads, std::max<std::size_t>(1, strata.size()));
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&, t] {
+            ChainSampler chain(splits);
+            std::vector<double> point(static_cast<std::size_t>(dims));
+            for (std::size_t h = t; h < strata.size(); h += num_threads) {
+                // Hashed, so neighbouring seeds or strata do not walk overlapping splitmix64 sequences
+                std::uint64_t seed_state = options.seed;
+                std::uint64_t state = splitmix64(seed_state) ^ h;
+                state = splitmix64(state);
+                if (options.points == PointSet::Random) {
+                    auto uniform = [&](int) { return to_unit(splitmix64(state)); };
+                    for (std::uint64_t i = 0; i < strata[h].samples; ++i) {
+                        tally(tallies[h], chain.run(strata[h].config, num_leaf - picks_done, picks, uniform));
+                    }
+                } else {
+                    // Cranley-Patterson shift per stratum keeps every point uniform, hence the estimate unbiased
+                    for (int d = 0; d < dims; ++d) {
+                        point[static_cast<std::size_t>(d)] = to_unit(splitmix64(state));
+                    }
+                    auto uniform = [&](int d) { return point[static_cast<std::size_t>(d)]; };
+                    for (std::uint64_t i = 0; i < strata[h].samples; ++i) {
+                        tally(tallies[h], chain.run(strata[h].config, num_leaf - picks_done, picks, uniform));
+                        for (int d = 0; d < dims; ++d) {
+                            double& x = point[static_cast<std::size_t>(d)];
+                            x += alpha[static_cast<std::size_t>(d)];
+                            x -= std::floor(x);
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return tallies;
+}
+
+StratifiedResult combine(const std::vector<Stratum>& strata, const std::vector<std::vector<std::uint64_t>>& tallies) {
+    std::map<int, double> mass;
+    StratifiedResult result;
+    result.strata = strata.size();
+    for (std::size_t h = 0; h < strata.size(); ++h) {
+        result.samples += strata[h].samples;
+        for (std::size_t pnodes = 0; pnodes < tallies[h].size(); ++pnodes) {
+            std::uint64_t count = tallies[h][pnodes];
+            if (count == 0) continue;
+            mass[static_cast<int>(pnodes)] += strata[h].weight * static_cast<double>(count) / static_cast<double>(strata[h].samples);
+        }
+    }
+    result.histogram.assign(mass.begin(), mass.end());
+    return result;
+}
+
+// Estimated P(pnodes <= probe)
+double cdf_at(const Histogram& hist, int probe) {
+    double cumulative = 0;
+    for (const auto& [pnodes, prob] : hist) {
+        if (pnodes > probe) break;
+        cumulative += prob;
+    }
+    return cumulative;
+}
+
+} // namespace
+
+bool parse_point_set(const std::string& name, PointSet& points) {
+    if (name == "random") {
+        points = PointSet::Random;
+    } else if (name == "lattice") {
+        points = PointSet::Lattice;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+StratifiedResult sample_stratified(int num_leaf, int tau, std::uint64_t samples, const StratifiedOptions& options) {
+    if (num_leaf <= 0 || tau < 0 || samples == 0) {
+        throw std::invalid_argument("Invalid stratified sampling parameters");
+    }
+    tau = std::min(tau, num_leaf);
+    int picks_done = std::clamp(options.strata_picks, 0, tau);
+    std::vector<Stratum> strata = build_strata(num_leaf, picks_done, samples);
+    return combine(strata, run_strata(num_leaf, tau, strata, picks_done, options));
+}
+
+std::vector<VarianceReport> compare_variance(int num_leaf, int tau, std::uint64_t samples, int replicates,
+                                             const StratifiedOptions& options, std::vector<int>& probes) {
+    using namespace std::chrono;
+    if (num_leaf <= 0 || tau < 0 || samples == 0 || replicates < 2) {
+        throw std::invalid_argument("Invalid variance comparison parameters");
+    }
+    tau = std::min(tau, num_leaf);
+    int picks_done = std::clamp(options.strata_picks, 0, tau);
+
+    PnodeHistogram exact;
+    sample_reduce(num_leaf, tau, exact);
+    Histogram exact_hist = exact.result();
+    probes.clear();
+    for (double q : {0.125, 0.25, 0.5}) {
+        double cumulative = 0;
+        for (const auto& [pnodes, prob] : exact_hist) {
+            cumulative += prob;
+            if (cumulative >= q) {
+                probes.push_back(pnodes);
+                break;
+            }
+        }
+    }
+
+    // The strata are exact and shared by every replicate; their cost is charged to each one
+    auto strata_start = steady_clock::now();
+    std::vector<Stratum> strata = build_strata(num_leaf, picks_done, samples);
+    double strata_seconds = duration<double>(steady_clock::now() - strata_start).count();
+    std::vector<Stratum> chain_only = build_strata(num_leaf, 0, samples);
+
+    auto replicate = [&](const std::string& method, auto&& estimate) {
+        VarianceReport report;
+        report.method = method;
+        std::vector<std::vector<double>> values(probes.size());
+        for (int r = 0; r < replicates; ++r) {
+            auto start = steady_clock::now();
+            StratifiedResult result = estimate(static_cast<std::uint64_t>(r) + options.seed);
+            report.seconds += duration<double>(steady_clock::now() - start).count();
+            report.samples = result.samples;
+            for (std::size_t p = 0; p < probes.size(); ++p) {
+                values[p].push_back(cdf_at(result.histogram, probes[p]));
+            }
+        }
+        report.seconds /= replicates;
+        for (const std::vector<double>& v : values) {
+            double mean = 0, sum_sq = 0;
+            for (double x : v) mean += x / static_cast<double>(v.size());
+            for (double x : v) sum_sq += (x - mean) * (x - mean);
+            report.variance.push_back(sum_sq / static_cast<double>(v.size() - 1));
+        }
+        return report;
+    };
+
+    std::vector<VarianceReport> reports;
+    reports.push_back(replicate("plain", [&](std::uint64_t seed) {
+        McParams params;
+        params.num_leaf = num_leaf;
+        params.tau = tau;
+        params.seed = seed;
+        params.samples_per_stream = std::max<std::uint64_t>(1, samples / 64);
+        McResult mc = sample_monte_carlo(params, 0, 64, options.threads);
+        return StratifiedResult{mc.histogram(), mc.samples, 1};
+    }));
+    StratifiedOptions run = options;
+    reports.push_back(replicate("chain", [&](std::uint64_t seed) {
+        run.seed = seed;
+        run.points = PointSet::Random;
+        return combine(chain_only, run_strata(num_leaf, tau, chain_only, 0, run));
+    }));
+    for (PointSet points : {PointSet::Random, PointSet::Lattice}) {
+        std::string name = points == PointSet::Random ? "stratified" : "stratified+lattice";
+        reports.push_back(replicate(name, [&](std::uint64_t seed) {
+            run.seed = seed;
+            run.points = points;
+            return combine(strata, run_strata(num_leaf, tau, strata, picks_done, run));
+        }));
+        reports.back().seconds += strata_seconds;
+    }
+
+    const VarianceReport& plain = reports.front();
+    for (VarianceReport& report : reports) {
+        for (std::size_t p = 0; p < probes.size(); ++p) {
+            double cost = report.variance[p] * report.seconds;
+            report.reduction.push_back(cost > 0 ? plain.variance[p] * plain.seconds / cost : INFINITY);
+        }
+    }
+    return reports;
+}
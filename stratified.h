@@ -0,0 +1,73 @@
+#ifndef STRATIFIED_H
+#define STRATIFIED_H
+
+#include "tree_utils.h" // For Histogram
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Where the uniforms driving the remaining picks come from.
+ */
+enum class PointSet {
+    Random,  // Independent uniforms
+    Lattice, // Randomly shifted rank-1 lattice (Kronecker sequence), one per stratum
+};
+
+/**
+ * @brief Parses "random" or "lattice". Returns false for anything else.
+ */
+bool parse_point_set(const std::string& name, PointSet& points);
+
+struct StratifiedOptions {
+    int strata_picks = 6;                // The first picks are enumerated exactly; their configs are the strata
+    PointSet points = PointSet::Random;
+    std::uint64_t seed = 1;
+    int threads = 1;                     // The result does not depend on it
+};
+
+struct StratifiedResult {
+    Histogram histogram;     // Estimated distribution of the number of revealed nodes
+    std::uint64_t samples = 0;
+    std::size_t strata = 0;
+};
+
+/**
+ * @brief Estimates the revealed-node distribution with stratified sampling.
+ *
+ * The frontier after options.strata_picks picks is computed exactly by the step
+ * engine, so every stratum (a config) comes with its exact weight. Each stratum gets
+ * a share of the samples proportional to its weight, at least one, and the remaining
+ * picks are sampled on the config chain: a uniform picks a subtree in proportion to
+ * its leaves, a second one picks an outcome from the split table. Stratum estimates
+ * are combined with the exact weights, so the estimate is unbiased for any allocation.
+ * With strata_picks = 0 this is plain Monte Carlo on the config chain.
+ * @param num_leaf Number of leaves of the tree.
+ * @param tau Number of picks.
+ * @param samples Total number of samples (before rounding the allocation).
+ */
+StratifiedResult sample_stratified(int num_leaf, int tau, std::uint64_t samples, const StratifiedOptions& options);
+
+/**
+ * @brief Spread of one estimator over independent replicates.
+ */
+struct VarianceReport {
+    std::string method;
+    std::uint64_t samples = 0;      // Per replicate
+    double seconds = 0;             // Mean wall time per replicate
+    std::vector<double> variance;   // Of the estimated CDF at each probe point
+    std::vector<double> reduction;  // Plain-MC variance over this one, both scaled to the same wall time
+};
+
+/**
+ * @brief Compares plain Monte Carlo with the config-chain, stratified and lattice estimators.
+ *
+ * Every estimator is run replicates times with different seeds and the same sample
+ * budget. The CDF is probed at the exact 1/8, 1/4 and 1/2 quantiles (probes holds
+ * them on return). Variances are converted to equal wall time via variance * seconds.
+ */
+std::vector<VarianceReport> compare_variance(int num_leaf, int tau, std::uint64_t samples, int replicates,
+                                             const StratifiedOptions& options, std::vector<int>& probes);
+
+#endif // STRATIFIED_H
@@ -0,0 +1,82 @@
+#include "telemetry.h"
+
+#include <sys/resource.h> // For getrusage
+
+Telemetry& telemetry() {
+    static Telemetry instance;
+    return instance;
+}
+
+void reset_telemetry() {
+    Telemetry& t = telemetry();
+    // large_mappings and large_mapped_bytes are gauges of live mappings and are not reset;
+    // the peak restarts from what is still mapped, so it never reads below the gauge
+    t.large_mapped_peak.store(t.large_mapped_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (std::atomic<long long>* counter : {
+             &t.madvise_bytes,
+             &t.hugetlb_bytes, &t.hugetlb_fallbacks, &t.anon_huge_peak,
+             &t.transitions, &t.frontier_peak, &t.approx_merged_configs, &t.frontier_bytes_peak,
+             &t.checkpoints, &t.io_bytes_written, &t.io_write_ns, &t.io_fsync_ns, &t.io_stall_ns,
+             &t.net_bytes_sent, &t.net_batches_sent, &t.net_configs_sent, &t.net_barrier_ns,
+             &t.pipeline_batches, &t.pipeline_queued_batches, &t.pipeline_expander_waits,
+             &t.pipeline_aggregator_waits,
+             &t.current_step, &t.total_steps, &t.frontier_size, &t.steps_completed, &t.step_ns}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<long long>& count : t.step_latency_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void update_peak(std::atomic<long long>& peak, long long value) {
+    long long current = peak.load(std::memory_order_relaxed);
+    while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        // current is reloaded by compare_exchange_weak on failure
+    }
+}
+
+void record_step(int step, int steps, std::size_t frontier, long long elapsed_ns) {
+    Telemetry& t = telemetry();
+    t.current_step.store(step, std::memory_order_relaxed);
+    t.total_steps.store(steps, std::memory_order_relaxed);
+    t.frontier_size.store(static_cast<long long>(frontier), std::memory_order_relaxed);
+    t.steps_completed.fetch_add(1, std::memory_order_relaxed);
+    t.step_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    int bucket = 0;
+    while (bucket + 1 < kStepLatencyBuckets && elapsed_ns > kStepLatencyBounds[bucket] * 1e9) {
+        ++bucket;
+    }
+    t.step_latency_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void print_telemetry(std::ostream& os) {
+    const Telemetry& t = telemetry();
+    os << "Telemetry transitions = " << t.transitions << std::endl;
+    os << "Telemetry frontier_peak = " << t.frontier_peak << std::endl;
+    os << "Telemetry approx_merged_configs = " << t.approx_merged_configs << std::endl;
+    os << "Telemetry frontier_bytes_peak = " << t.frontier_bytes_peak << std::endl;
+    os << "Telemetry checkpoints = " << t.checkpoints << std::endl;
+    os << "Telemetry io_bytes_written = " << t.io_bytes_written << std::endl;
+    os << "Telemetry io_write_ms = " << t.io_write_ns / 1e6 << std::endl;
+    os << "Telemetry io_fsync_ms = " << t.io_fsync_ns / 1e6 << std::endl;
+    os << "Telemetry io_stall_ms = " << t.io_stall_ns / 1e6 << std::endl;
+    os << "Telemetry net_bytes_sent = " << t.net_bytes_sent << std::endl;
+    os << "Telemetry net_batches_sent = " << t.net_batches_sent << std::endl;
+    os << "Telemetry net_configs_sent = " << t.net_configs_sent << std::endl;
+    os << "Telemetry net_barrier_ms = " << t.net_barrier_ns / 1e6 << std::endl;
+    os << "Telemetry pipeline_batches = " << t.pipeline_batches << std::endl;
+    os << "Telemetry pipeline_mean_lane_fill = "
+       << (t.pipeline_batches > 0 ? static_cast<double>(t.pipeline_queued_batches) / t.pipeline_batches : 0.0)
+       << std::endl;
+    os << "Telemetry pipeline_expander_waits = " << t.pipeline_expander_waits << std::endl;
+    os << "Telemetry pipeline_aggregator_waits = " << t.pipeline_aggregator_waits << std::endl;
+    os << "Telemetry large_mapped_peak_bytes = " << t.large_mapped_peak << std::endl;
+    os << "Telemetry madvise_bytes = " << t.madvise_bytes << std::endl;
+    os << "Telemetry hugetlb_bytes = " << t.hugetlb_bytes << std::endl;
+    os << "Telemetry hugetlb_fallbacks = " << t.hugetlb_fallbacks << std::endl;
+    os << "Telemetry anon_huge_peak_bytes = " << t.anon_huge_peak << std::endl;
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // batch_run.py reads this line to admit sweep points against its RSS budget
+    os << "Telemetry peak_rss_bytes = " << usage.ru_maxrss * 1024LL << std::endl;
+}
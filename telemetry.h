@@ -0,0 +1,92 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+// Upper bounds in seconds of the step latency histogram; a last bucket holds the slower steps
+inline constexpr double kStepLatencyBounds[] = {0.001, 0.01, 0.1, 1, 10, 60, 300, 1800, 7200};
+inline constexpr int kStepLatencyBuckets = sizeof(kStepLatencyBounds) / sizeof(kStepLatencyBounds[0]) + 1;
+
+/**
+ * @brief Process-wide counters describing what the engine did.
+ *
+ * Counters are atomics so worker threads can bump them without locking.
+ * They are printed to stderr at the end of sample(). The sampling entry points
+ * (sampler.h, sample_reduce) reset them when they start; runs overlapping in one
+ * process share and reset the same counters.
+ */
+struct Telemetry {
+    // Large allocations (see hugepage.h)
+    std::atomic<long long> large_mappings{0};        // Number of live 2 MB-aligned mappings
+    std::atomic<long long> large_mapped_bytes{0};    // Bytes currently mapped by large_alloc
+    std::atomic<long long> large_mapped_peak{0};     // Peak of large_mapped_bytes since the last reset
+    std::atomic<long long> madvise_bytes{0};         // Bytes successfully hinted with MADV_HUGEPAGE
+    std::atomic<long long> hugetlb_bytes{0};         // Bytes obtained with MAP_HUGETLB
+    std::atomic<long long> hugetlb_fallbacks{0};     // MAP_HUGETLB attempts that fell back to madvise
+    std::atomic<long long> anon_huge_peak{0};        // Peak AnonHugePages of the whole process (smaps_rollup),
+                                                     // not only of large_alloc mappings; confirms THP backing
+
+    // Step loop
+    std::atomic<long long> transitions{0};           // Inserts into a next frontier
+    std::atomic<long long> frontier_peak{0};         // Largest frontier seen (number of configs)
+    std::atomic<long long> approx_merged_configs{0}; // Configs folded into another by --approx-cutoff
+    std::atomic<long long> frontier_bytes_peak{0};   // Peak bytes of current + next frontier at the end of a step
+
+    // Checkpoint I/O (see checkpoint.h)
+    std::atomic<long long> checkpoints{0};           // Checkpoints committed
+    std::atomic<long long> io_bytes_written{0};      // Bytes written by the I/O thread
+    std::atomic<long long> io_write_ns{0};           // Time the I/O thread spent in write()
+    std::atomic<long long> io_fsync_ns{0};           // Time the I/O thread spent in fsync()
+    std::atomic<long long> io_stall_ns{0};           // Time the step loop waited on the I/O thread
+
+    // Sharded engine (see sharded.h)
+    std::atomic<long long> net_bytes_sent{0};        // Bytes sent over sockets, framing included
+    std::atomic<long long> net_batches_sent{0};      // Transition batches sent to other shards
+    std::atomic<long long> net_configs_sent{0};      // Configs in those batches, after local combining
+    std::atomic<long long> net_barrier_ns{0};        // Time spent waiting for other shards to finish a step
+
+    // Pipelined engine (see pipeline.h)
+    std::atomic<long long> pipeline_batches{0};          // Transition batches taken by aggregators
+    std::atomic<long long> pipeline_queued_batches{0};   // Sum of the lane fill seen at each take
+    std::atomic<long long> pipeline_expander_waits{0};   // Yields of expanders waiting for an empty batch
+    std::atomic<long long> pipeline_aggregator_waits{0}; // Yields of aggregators finding all lanes empty
+
+    // Progress of the running engine (see metrics.h)
+    std::atomic<long long> current_step{0};          // Picks applied so far
+    std::atomic<long long> total_steps{0};           // Picks the run will apply
+    std::atomic<long long> frontier_size{0};         // Configs in the frontier of the current step
+    std::atomic<long long> steps_completed{0};       // Engine passes finished (a fused pass counts once)
+    std::atomic<long long> step_ns{0};               // Time spent in those passes
+    std::atomic<long long> step_latency_counts[kStepLatencyBuckets] = {}; // Passes per kStepLatencyBounds bucket
+};
+
+/**
+ * @brief Returns the process-wide telemetry instance.
+ */
+Telemetry& telemetry();
+
+/**
+ * @brief Zeroes all counters, e.g. between the runs of a comparison.
+ */
+void reset_telemetry();
+
+/**
+ * @brief Raises an atomic peak counter to at least value.
+ */
+void update_peak(std::atomic<long long>& peak, long long value);
+
+/**
+ * @brief Records a finished engine pass that reached step out of steps.
+ * @param frontier Configs in the frontier the pass produced (or expanded, for the final pass).
+ * @param elapsed_ns Wall time of the pass.
+ */
+void record_step(int step, int steps, std::size_t frontier, long long elapsed_ns);
+
+/**
+ * @brief Writes all counters as "name = value" lines.
+ */
+void print_telemetry(std::ostream& os);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,433 @@
+#include "trace.h"
+#include "monte_carlo.h" // For ChallengeStream
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio> // For std::rename
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[8] = {'O', 'T', 'S', 'T', 'R', 'C', 'E', '1'};
+constexpr std::size_t kHeaderBytes = 40;
+
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_pod(const char*& cursor) {
+    T value;
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+}
+
+// Keys are below 2 * num_leaf <= 2^31, so they compare as signed 32-bit lanes
+constexpr long long kMaxTraceLeaves = 1LL << 30;
+constexpr int kMaxVectorTau = 64;    // Longer records are scored one at a time
+constexpr std::size_t kBlock = 4096; // Records scored per call of score_block
+
+// Shape of the heap-layout tree a trace indexes
+struct TreeShape {
+    std::int32_t num_leaf;
+    std::int32_t deep_first; // 2^max_depth: leaves below it sit one level above the deepest
+    int max_depth;
+    int tau;
+
+    TreeShape(long long leaves, int picks)
+        : num_leaf(static_cast<std::int32_t>(leaves)),
+          max_depth(63 - __builtin_clzll(static_cast<std::uint64_t>(2 * leaves - 1))), tau(picks) {
+        deep_first = static_cast<std::int32_t>(1LL << max_depth);
+    }
+};
+
+// Revealed nodes of one record, or -1 if a leaf is out of range or repeated.
+//
+// Left-aligning a heap index to the deepest level gives its DFS key, and the LCA of
+// two leaves sits above the highest bit in which their keys differ. Adding leaf i to
+// the union of the root paths of leaves 0..i-1 adds the nodes below its deepest LCA
+// with any of them, i.e. the smallest key XOR, so no sort is needed: leaf i adds
+// bitlen(min_j key_i ^ key_j) - [leaf i is shallow] nodes. This is count_copath_nodes
+// with the neighbour-in-DFS-order LCA replaced by the deepest LCA so far.
+int score_record(const std::uint32_t* offsets, const TreeShape& tree, std::int32_t* keys) {
+    int bits = 0;
+    bool invalid = false;
+    for (int i = 0; i < tree.tau; ++i) {
+        invalid |= offsets[i] >= static_cast<std::uint32_t>(tree.num_leaf);
+        std::int32_t index = tree.num_leaf + static_cast<std::int32_t>(offsets[i] & 0x3FFFFFFF);
+        std::int32_t key = index < tree.deep_first ? index << 1 : index;
+        std::int32_t nearest = 0x7FFFFFFF; // Stands for the root path before the first leaf
+        for (int j = 0; j < i; ++j) {
+            nearest = std::min(nearest, keys[j] ^ key);
+        }
+        keys[i] = key;
+        invalid |= nearest == 0;
+        bits += 32 - __builtin_clz(static_cast<std::uint32_t>(nearest) | 1) - (key >= 2 * tree.num_leaf);
+    }
+    // The first leaf counted 31 bits for its depth + 1 path nodes
+    return invalid ? -1 : bits - 31 + tree.max_depth + 1 - 2 * tree.tau + 1;
+}
+
+// GCC vector types of W 32-bit lanes, and of W 64-bit lanes for the exact int-to-double conversion
+template <int W> struct Vectors;
+template <> struct Vectors<4> {
+    typedef std::int32_t Lanes __attribute__((vector_size(16)));
+    typedef double WideLanes __attribute__((vector_size(32)));
+    typedef std::int64_t WideInts __attribute__((vector_size(32)));
+};
+template <> struct Vectors<8> {
+    typedef std::int32_t Lanes __attribute__((vector_size(32)));
+    typedef double WideLanes __attribute__((vector_size(64)));
+    typedef std::int64_t WideInts __attribute__((vector_size(64)));
+};
+
+// score_record on W records at once, one per vector lane
+template <int W>
+__attribute__((always_inline)) inline void score_lanes(const std::uint32_t* records, const TreeShape& tree, int* out) {
+    using Lanes = typename Vectors<W>::Lanes;
+    using WideLanes = typename Vectors<W>::WideLanes;
+    using WideInts = typename Vectors<W>::WideInts;
+
+    Lanes keys[kMaxVectorTau];
+    Lanes exponents = Lanes{} + 0;
+    Lanes invalid = Lanes{} + 0;
+    Lanes deep_first = Lanes{} + tree.deep_first;
+    Lanes shallow_keys = Lanes{} + 2 * tree.num_leaf;
+    for (int i = 0; i < tree.tau; ++i) {
+        Lanes offset;
+        for (int lane = 0; lane < W; ++lane) {
+            offset[lane] = static_cast<std::int32_t>(records[lane * tree.tau + i]);
+        }
+        invalid |= (offset < 0) | (offset >= tree.num_leaf);
+        Lanes key = (offset & 0x3FFFFFFF) + tree.num_leaf; // Masked so invalid offsets cannot overflow
+        key = key < deep_first ? key + key : key;
+        Lanes nearest = Lanes{} + 0x7FFFFFFF;
+        for (int j = 0; j < i; ++j) {
+            Lanes diff = keys[j] ^ key;
+            nearest = diff < nearest ? diff : nearest;
+        }
+        keys[i] = key;
+        invalid |= nearest == 0;
+        exponents += key >= shallow_keys; // Comparisons yield -1 per true lane
+        // Exponent of the exactly converted double is bitlen - 1 + 1023
+        WideInts wide = reinterpret_cast<WideInts>(__builtin_convertvector(nearest | 1, WideLanes));
+        exponents += __builtin_convertvector(wide >> 52, Lanes);
+    }
+    int base = -1022 * tree.tau - 31 + tree.max_depth + 1 - 2 * tree.tau + 1;
+    for (int lane = 0; lane < W; ++lane) {
+        out[lane] = invalid[lane] ? -1 : exponents[lane] + base;
+    }
+}
+
+template <int W>
+__attribute__((always_inline)) inline void score_block_impl(const std::uint32_t* records, std::size_t count,
+                                                           const TreeShape& tree, int* out) {
+    std::size_t r = 0;
+    if (tree.tau <= kMaxVectorTau) {
+        for (; r + W <= count; r += W) {
+            score_lanes<W>(records + r * tree.tau, tree, out + r);
+        }
+    }
+    std::int32_t keys[kMaxVectorTau];
+    std::vector<std::int32_t> long_keys(tree.tau > kMaxVectorTau ? tree.tau : 0);
+    for (; r < count; ++r) {
+        out[r] = score_record(records + r * tree.tau, tree, long_keys.empty() ? keys : long_keys.data());
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2"))) void score_block_avx2(const std::uint32_t* records, std::size_t count,
+                                                      const TreeShape& tree, int* out) {
+    score_block_impl<8>(records, count, tree, out);
+}
+#endif
+
+// Scores count consecutive records into out, with 8 lanes where the CPU has AVX2
+void score_block(const std::uint32_t* records, std::size_t count, const TreeShape& tree, int* out) {
+#if defined(__GNUC__) && defined(__x86_64__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2) {
+        score_block_avx2(records, count, tree, out);
+        return;
+    }
+#endif
+    score_block_impl<4>(records, count, tree, out);
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+        }
+        struct stat info {};
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("Cannot stat " + path + ": " + std::strerror(errno));
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+            }
+            data_ = static_cast<const char*>(data);
+            madvise(data, size_, MADV_SEQUENTIAL); // Each thread streams through its range once
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Regularized upper incomplete gamma function Q(a, x), as in Numerical Recipes
+double gamma_q(double a, double x) {
+    if (x <= 0) return 1;
+    if (std::isinf(x)) return 0;
+    double log_prefix = -x + a * std::log(x) - std::lgamma(a);
+    if (x < a + 1) {
+        // Series for P(a, x)
+        double term = 1 / a, sum = term;
+        for (int n = 1; n < 10000 && std::fabs(term) > std::fabs(sum) * 1e-15; ++n) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return std::max(0.0, 1 - sum * std::exp(log_prefix));
+    }
+    // Continued fraction for Q(a, x) (modified Lentz)
+    const double tiny = 1e-300;
+    double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+    for (int n = 1; n < 10000; ++n) {
+        double an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1) < 1e-15) break;
+    }
+    return std::exp(log_prefix) * h;
+}
+
+} // namespace
+
+void generate_trace(const std::string& path, const TraceHeader& params, std::uint64_t seed, int modulo_bits) {
+    auto [t0, k0, t1, k1] = _vc_param(params.csp - params.w_grind, params.tau);
+    long long num_leaf = (1LL << k0) * t0 + (1LL << k1) * t1;
+    if (num_leaf <= 0 || num_leaf > kMaxTraceLeaves || params.tau <= 0 || params.tau > num_leaf) {
+        throw std::invalid_argument("No trace layout for these parameters");
+    }
+    if (modulo_bits < 0 || modulo_bits > 64 || (modulo_bits > 0 && modulo_bits < 63 && (1LL << modulo_bits) < params.tau)) {
+        throw std::invalid_argument("Modulo bits must be in [0, 64] and leave room for tau distinct leaves");
+    }
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(kMagic, sizeof(kMagic));
+        write_pod(out, static_cast<std::int32_t>(params.csp));
+        write_pod(out, static_cast<std::int32_t>(params.tau));
+        write_pod(out, static_cast<std::int32_t>(params.w_grind));
+        write_pod(out, static_cast<std::int32_t>(0));
+        write_pod(out, static_cast<std::int64_t>(num_leaf));
+        write_pod(out, params.records);
+
+        ChallengeStream challenges(seed, 0, num_leaf, params.tau);
+        std::mt19937_64 rng(seed);
+        std::uint64_t mask = modulo_bits == 64 ? ~0ULL : (1ULL << modulo_bits) - 1;
+        std::vector<long long> leaves;
+        std::vector<std::uint32_t> record(static_cast<std::size_t>(params.tau));
+        for (std::uint64_t r = 0; r < params.records; ++r) {
+            if (modulo_bits == 0) {
+                challenges.next(leaves);
+                for (int i = 0; i < params.tau; ++i) {
+                    record[i] = static_cast<std::uint32_t>(leaves[i] - num_leaf);
+                }
+            } else {
+                for (int i = 0; i < params.tau; ++i) {
+                    do {
+                        record[i] = static_cast<std::uint32_t>((rng() & mask) % static_cast<std::uint64_t>(num_leaf));
+                    } while (std::find(record.begin(), record.begin() + i, record[i]) != record.begin() + i);
+                }
+            }
+            out.write(reinterpret_cast<const char*>(record.data()), record.size() * sizeof(std::uint32_t));
+        }
+        if (!out.flush()) {
+            throw std::runtime_error("Cannot write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot rename " + tmp + " to " + path);
+    }
+}
+
+TraceAnalysis analyze_trace(const std::string& path, int threads) {
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file(path);
+    if (file.size() < kHeaderBytes || std::memcmp(file.data(), kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error(path + " is not a challenge trace");
+    }
+    TraceAnalysis result;
+    const char* cursor = file.data() + sizeof(kMagic);
+    result.header.csp = read_pod<std::int32_t>(cursor);
+    result.header.tau = read_pod<std::int32_t>(cursor);
+    result.header.w_grind = read_pod<std::int32_t>(cursor);
+    read_pod<std::int32_t>(cursor); // Padding
+    result.header.num_leaf = read_pod<std::int64_t>(cursor);
+    result.header.records = read_pod<std::uint64_t>(cursor);
+    const TraceHeader& header = result.header;
+    if (header.tau <= 0 || header.num_leaf < header.tau || header.num_leaf > kMaxTraceLeaves) {
+        throw std::runtime_error(path + " has an invalid header");
+    }
+    std::size_t record_bytes = static_cast<std::size_t>(header.tau) * sizeof(std::uint32_t);
+    if ((file.size() - kHeaderBytes) / record_bytes < header.records) {
+        throw std::runtime_error("Truncated trace " + path);
+    }
+    const std::uint32_t* records = reinterpret_cast<const std::uint32_t*>(file.data() + kHeaderBytes);
+
+    TreeShape tree(header.num_leaf, header.tau);
+
+    // The vector kernel has to agree with the reference on the leading records
+    {
+        std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(header.records, kBlock));
+        std::vector<int> pnodes(count);
+        score_block(records, count, tree, pnodes.data());
+        std::vector<long long> leaves;
+        for (std::size_t r = 0; r < count; ++r) {
+            if (pnodes[r] < 0) continue;
+            const std::uint32_t* record = records + r * static_cast<std::size_t>(header.tau);
+            leaves.assign(record, record + header.tau);
+            for (long long& leaf : leaves) leaf += header.num_leaf;
+            if (count_copath_nodes(leaves, header.num_leaf) != pnodes[r]) {
+                throw std::logic_error("Co-path kernel disagrees with count_copath_nodes on record " + std::to_string(r));
+            }
+        }
+    }
+
+    threads = std::max(1, threads);
+    std::vector<std::vector<std::uint64_t>> counts(static_cast<std::size_t>(threads));
+    std::vector<std::uint64_t> invalid(static_cast<std::size_t>(threads), 0);
+    // A record reveals at most tau * depth nodes
+    std::size_t max_pnodes = static_cast<std::size_t>(header.tau) * 64 + 1;
+    auto scan = [&](int t) {
+        std::uint64_t begin = header.records * t / threads;
+        std::uint64_t end = header.records * (t + 1) / threads;
+        std::vector<std::uint64_t>& local = counts[t];
+        local.assign(max_pnodes, 0);
+        std::vector<int> pnodes(kBlock);
+        std::uint64_t bad = 0;
+        for (std::uint64_t r = begin; r < end; r += kBlock) {
+            std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(kBlock, end - r));
+            score_block(records + r * static_cast<std::uint64_t>(header.tau), count, tree, pnodes.data());
+            for (std::size_t i = 0; i < count; ++i) {
+                if (pnodes[i] < 0) {
+                    ++bad;
+                } else {
+                    ++local[static_cast<std::size_t>(pnodes[i])];
+                }
+            }
+        }
+        invalid[t] = bad;
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t) {
+        workers.emplace_back(scan, t);
+    }
+    scan(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int t = 0; t < threads; ++t) {
+        result.invalid += invalid[t];
+        for (std::size_t pnodes = 0; pnodes < max_pnodes; ++pnodes) {
+            if (counts[t][pnodes] != 0) {
+                result.tally[static_cast<int>(pnodes)] += counts[t][pnodes];
+            }
+        }
+    }
+    return result;
+}
+
+FitReport goodness_of_fit(const std::map<int, std::uint64_t>& tally, const Histogram& exact) {
+    FitReport report;
+    std::map<int, std::pair<std::uint64_t, double>> bins; // pnodes -> (observed, model probability)
+    for (const auto& [pnodes, count] : tally) {
+        bins[pnodes].first += count;
+        report.samples += count;
+    }
+    for (const auto& [pnodes, prob] : exact) {
+        bins[pnodes].second += prob;
+    }
+    if (report.samples == 0) {
+        return report;
+    }
+    double n = static_cast<double>(report.samples);
+
+    double observed_cdf = 0, model_cdf = 0;
+    for (const auto& [pnodes, bin] : bins) {
+        double frequency = bin.first / n;
+        report.tv_distance += std::fabs(frequency - bin.second) / 2;
+        observed_cdf += frequency;
+        model_cdf += bin.second;
+        report.ks_distance = std::max(report.ks_distance, std::fabs(observed_cdf - model_cdf));
+        if (bin.second == 0) {
+            report.impossible += bin.first;
+        }
+    }
+
+    // Pool neighbouring bins until each expects at least 5 records; a short tail joins the last pool
+    std::vector<std::pair<double, double>> pools; // (observed, expected)
+    std::pair<double, double> open{0, 0};
+    for (const auto& [pnodes, bin] : bins) {
+        open.first += bin.first;
+        open.second += bin.second * n;
+        if (open.second >= 5) {
+            pools.push_back(open);
+            open = {0, 0};
+        }
+    }
+    if (pools.empty()) {
+        pools.push_back(open);
+    } else {
+        pools.back().first += open.first;
+        pools.back().second += open.second;
+    }
+    for (const auto& [observed, expected] : pools) {
+        double delta = observed - expected;
+        report.chi_square += expected > 0 ? delta * delta / expected : (observed > 0 ? INFINITY : 0);
+    }
+    report.dof = static_cast<int>(pools.size()) - 1;
+    report.p_value = report.dof > 0 ? gamma_q(report.dof / 2.0, report.chi_square / 2) : 1;
+    return report;
+}
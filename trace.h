@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "tree_utils.h" // For Histogram
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * @brief Parameters of a challenge trace recorded by a signer.
+ */
+struct TraceHeader {
+    int csp = 0;
+    int tau = 0;              // Leaves per record
+    int w_grind = 0;
+    long long num_leaf = 0;   // Leaves of the tree the offsets index
+    std::uint64_t records = 0;
+};
+
+/**
+ * @brief Writes a synthetic trace of records challenges, e.g. to exercise analyze_trace.
+ *
+ * Layout (native endianness): the 8-byte magic "OTSTRCE1", int32 csp, int32 tau,
+ * int32 w_grind, int32 zero, int64 num_leaf, uint64 records, then records * tau
+ * uint32 leaf offsets in [0, num_leaf) (heap index num_leaf + offset, as in tree_utils).
+ * With modulo_bits == 0 the challenges come from ChallengeStream(seed, 0); otherwise
+ * every leaf is a uniform modulo_bits-bit number reduced mod num_leaf (redrawn if
+ * repeated), the modulo bias of a careless signer. num_leaf is derived from csp - w_grind
+ * and tau (at most 2^30). Written to "<path>.tmp" and renamed; throws std::runtime_error on I/O errors.
+ */
+void generate_trace(const std::string& path, const TraceHeader& params, std::uint64_t seed, int modulo_bits = 0);
+
+/**
+ * @brief Empirical revealed-node distribution of a trace.
+ */
+struct TraceAnalysis {
+    TraceHeader header;
+    std::uint64_t invalid = 0;           // Records with an out-of-range or repeated leaf; not tallied
+    std::map<int, std::uint64_t> tally;  // Number of revealed nodes -> number of records
+    double seconds = 0;                  // Wall time of mapping and scanning
+};
+
+/**
+ * @brief Memory-maps a trace and tallies the revealed nodes of every record.
+ *
+ * Records are split into one contiguous range per thread. Each record is scored with
+ * the DFS keys and bit-trick LCAs of count_copath_nodes, but without sorting: a leaf
+ * adds the path below its deepest LCA with the leaves before it, which comes from the
+ * smallest key XOR. Eight records (four without AVX2) are scored at once in vector
+ * lanes. The first records are also scored with count_copath_nodes itself and must
+ * agree. Supports num_leaf up to 2^30.
+ * Throws std::runtime_error if the file is not a complete trace.
+ */
+TraceAnalysis analyze_trace(const std::string& path, int threads = 1);
+
+/**
+ * @brief How well a tally matches a model histogram.
+ */
+struct FitReport {
+    std::uint64_t samples = 0;
+    double chi_square = 0;  // Pearson statistic over bins pooled to at least 5 expected records
+    int dof = 0;            // Pooled bins - 1
+    double p_value = 1;     // Upper tail of the chi-square distribution with dof degrees of freedom
+    double tv_distance = 0; // Between the empirical and model distributions
+    double ks_distance = 0; // Largest CDF gap
+    std::uint64_t impossible = 0; // Records whose count has probability 0 in the model
+};
+
+/**
+ * @brief Compares a tally with the exact histogram (e.g. from sample_reduce with PnodeHistogram).
+ */
+FitReport goodness_of_fit(const std::map<int, std::uint64_t>& tally, const Histogram& exact);
+
+#endif // TRACE_H
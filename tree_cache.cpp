@@ -0,0 +1,111 @@
+#include "tree_cache.h"
+#include "monte_carlo.h" // For run_challenge_streams
+#include "tree_utils.h"  // For heap_depth, subtree_leaf_count
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+struct CostCounts {
+    long long num_leaf;
+    int max_depth;
+    std::vector<std::vector<std::uint64_t>> counts; // counts[c][k]: challenges needing k expansions with cache depth c
+    std::unordered_map<long long, int> opened_below; // Union node -> opened leaves below it
+    std::vector<int> expansions_at;
+
+    explicit CostCounts(long long leaf_count)
+        : num_leaf(leaf_count), max_depth(heap_depth(2 * leaf_count - 1)),
+          counts(static_cast<std::size_t>(max_depth) + 1), expansions_at(static_cast<std::size_t>(max_depth) + 1) {}
+
+    void add(const std::vector<long long>& leaves) {
+        opened_below.clear();
+        for (long long leaf : leaves) {
+            for (long long node = leaf; node >= 1; node >>= 1) {
+                ++opened_below[node];
+            }
+        }
+
+        // An internal union node is expanded unless every leaf below it is opened
+        std::fill(expansions_at.begin(), expansions_at.end(), 0);
+        for (const auto& [node, opened] : opened_below) {
+            if (node < num_leaf && opened < subtree_leaf_count(node, num_leaf)) {
+                ++expansions_at[static_cast<std::size_t>(heap_depth(node))];
+            }
+        }
+
+        // Cache depth c pays for the expansions at depths >= c
+        int cost = 0;
+        for (int c = max_depth; c >= 0; --c) {
+            cost += expansions_at[static_cast<std::size_t>(c)];
+            std::vector<std::uint64_t>& row = counts[static_cast<std::size_t>(c)];
+            if (static_cast<std::size_t>(cost) >= row.size()) {
+                row.resize(static_cast<std::size_t>(cost) + 1, 0);
+            }
+            ++row[static_cast<std::size_t>(cost)];
+        }
+    }
+
+    void merge(const CostCounts& other) {
+        for (std::size_t c = 0; c < counts.size(); ++c) {
+            const std::vector<std::uint64_t>& part = other.counts[c];
+            std::vector<std::uint64_t>& row = counts[c];
+            if (part.size() > row.size()) {
+                row.resize(part.size(), 0);
+            }
+            for (std::size_t cost = 0; cost < part.size(); ++cost) {
+                row[cost] += part[cost];
+            }
+        }
+    }
+};
+
+// Smallest cost whose cumulative count reaches fraction q of the samples
+int cost_quantile(const std::vector<std::uint64_t>& row, std::uint64_t samples, double q) {
+    std::uint64_t target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * static_cast<double>(samples) + 0.5));
+    std::uint64_t cumulative = 0;
+    for (std::size_t cost = 0; cost < row.size(); ++cost) {
+        cumulative += row[cost];
+        if (cumulative >= target) {
+            return static_cast<int>(cost);
+        }
+    }
+    return row.empty() ? 0 : static_cast<int>(row.size()) - 1;
+}
+
+} // namespace
+
+std::vector<CacheTradeoff> simulate_tree_cache(long long num_leaf, int tau, int node_bytes,
+                                               std::uint64_t samples, std::uint64_t seed, int threads) {
+    if (num_leaf <= 0 || tau < 0 || samples == 0) {
+        throw std::invalid_argument("Invalid tree cache parameters");
+    }
+    CostCounts costs = run_challenge_streams(num_leaf, tau, samples, seed, threads, CostCounts(num_leaf));
+
+    std::vector<CacheTradeoff> rows;
+    double best_mean = -1;
+    for (int c = 0; c <= costs.max_depth; ++c) {
+        const std::vector<std::uint64_t>& row = costs.counts[static_cast<std::size_t>(c)];
+        double total = 0;
+        for (std::size_t cost = 0; cost < row.size(); ++cost) {
+            total += static_cast<double>(cost) * static_cast<double>(row[cost]);
+        }
+
+        CacheTradeoff tradeoff;
+        tradeoff.cache_depth = c;
+        // The heap is contiguous: depths 0..c hold indices 1 .. 2^(c+1) - 1
+        tradeoff.cached_nodes = std::min((2LL << c) - 1, 2 * num_leaf - 1);
+        tradeoff.memory_bytes = tradeoff.cached_nodes * node_bytes;
+        tradeoff.mean_expansions = total / static_cast<double>(samples);
+        tradeoff.p50 = cost_quantile(row, samples, 0.5);
+        tradeoff.p99 = cost_quantile(row, samples, 0.99);
+        tradeoff.max = row.empty() ? 0 : static_cast<int>(row.size()) - 1;
+        tradeoff.pareto = best_mean < 0 || tradeoff.mean_expansions < best_mean;
+        if (tradeoff.pareto) {
+            best_mean = tradeoff.mean_expansions;
+        }
+        rows.push_back(tradeoff);
+    }
+    return rows;
+}
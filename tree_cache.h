@@ -0,0 +1,42 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Cost of answering openings when the signer caches the top of its seed tree.
+ */
+struct CacheTradeoff {
+    int cache_depth;            // Nodes at depths 0..cache_depth are kept
+    long long cached_nodes;
+    long long memory_bytes;     // cached_nodes * node_bytes
+    double mean_expansions;     // Expected PRG expansions per opening
+    int p50;                    // Median, 99th percentile and maximum seen
+    int p99;
+    int max;
+    bool pareto;                // No cheaper cache depth has an equal or lower mean
+};
+
+/**
+ * @brief Simulates the memory/latency tradeoff of a signer's seed-tree cache.
+ *
+ * A signer holding only the nodes down to cache_depth rebuilds every revealed node
+ * below it from its cached ancestor, one PRG expansion (parent -> both children) per
+ * level. Expansions are shared between revealed nodes, so an opening costs one
+ * expansion per node on the union of the opened leaves' root paths that is at depth
+ * cache_depth or deeper and still has a revealed node below it. Challenges are drawn as
+ * in sample_monte_carlo (ChallengeStream), and every cache depth from 0 (root only) to
+ * the full tree is evaluated on the same challenges.
+ * @param num_leaf Number of leaves of the tree.
+ * @param tau Number of opened leaves per challenge.
+ * @param node_bytes Bytes stored per cached node (one csp-bit seed).
+ * @param samples Number of challenges to simulate.
+ * @param seed Seed of the challenge streams.
+ * @param threads Worker threads; the result does not depend on it.
+ * @return One row per cache depth.
+ */
+std::vector<CacheTradeoff> simulate_tree_cache(long long num_leaf, int tau, int node_bytes,
+                                               std::uint64_t samples, std::uint64_t seed, int threads = 1);
+
+#endif // TREE_CACHE_H
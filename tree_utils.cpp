@@ -100,6 +100,58 @@ std::optional<Config> decrease_config(const Config& config, int num_leaf) {
     return config_dict_to_tuple(config_new_dict); // Return the modified config
 }
 
+namespace {
+
+// Merges a sorted split result into config, decreasing the count at each index in
+// `removed` (an index may appear twice) and dropping sizes whose count reaches zero.
+void merge_split(const std::pair<int, int>* config, std::size_t len,
+                 std::size_t removed_a, std::size_t removed_b,
+                 const std::pair<int, int>* split, std::size_t split_len, Config& out) {
+    out.clear();
+    std::size_t i = 0, j = 0;
+    while (i < len || j < split_len) {
+        std::pair<int, int> next;
+        bool from_config = false;
+        if (j == split_len || (i < len && config[i].first < split[j].first)) {
+            next = config[i];
+            from_config = true;
+        } else if (i == len || split[j].first < config[i].first) {
+            next = split[j];
+            ++j;
+        } else {
+            next = {config[i].first, config[i].second + split[j].second};
+            from_config = true;
+            ++j;
+        }
+        if (from_config) {
+            if (i == removed_a) next.second -= 1;
+            if (i == removed_b) next.second -= 1;
+            ++i;
+        }
+        if (next.second != 0) {
+            out.push_back(next); // Drop sizes whose count reached zero
+        }
+    }
+}
+
+} // namespace
+
+void apply_split(const std::pair<int, int>* config, std::size_t len, std::size_t split_index,
+                 const Config& split, Config& out) {
+    merge_split(config, len, split_index, static_cast<std::size_t>(-1), split.data(), split.size(), out);
+}
+
+void apply_split(const std::pair<int, int>* config, std::size_t len, std::size_t split_index,
+                 const std::pair<int, int>* split, std::size_t split_len, Config& out) {
+    merge_split(config, len, split_index, static_cast<std::size_t>(-1), split, split_len, out);
+}
+
+void apply_double_split(const std::pair<int, int>* config, std::size_t len,
+                        std::size_t first_index, std::size_t second_index,
+                        const Config& split, Config& out) {
+    merge_split(config, len, first_index, second_index, split.data(), split.size(), out);
+}
+
 
 Histogram get_hist(const Distribution& dist) {
     std::map<int, double> hist_dict;
@@ -167,3 +219,48 @@ int vc_param(int csp, int tau) {
     // }
     return static_cast<int>(topen_ll);
 }
+
+
+int count_copath_nodes(std::vector<long long>& leaves, long long num_leaf) {
+    if (leaves.empty()) {
+        return 1;
+    }
+    // Leaves sit on the two deepest levels; left-aligning them to the deepest level gives DFS order
+    int max_depth = heap_depth(2 * num_leaf - 1);
+    std::sort(leaves.begin(), leaves.end(), [max_depth](long long a, long long b) {
+        return (static_cast<unsigned long long>(a) << (max_depth - heap_depth(a)))
+             < (static_cast<unsigned long long>(b) << (max_depth - heap_depth(b)));
+    });
+
+    long long union_nodes = heap_depth(leaves[0]) + 1;
+    for (std::size_t i = 1; i < leaves.size(); ++i) {
+        unsigned long long a = static_cast<unsigned long long>(leaves[i - 1]);
+        unsigned long long b = static_cast<unsigned long long>(leaves[i]);
+        int depth_a = heap_depth(a);
+        int depth_b = heap_depth(b);
+        int common = std::min(depth_a, depth_b);
+        unsigned long long diff = (a >> (depth_a - common)) ^ (b >> (depth_b - common));
+        int lca_depth = diff == 0 ? common : common - (64 - __builtin_clzll(diff));
+        // The path of b below its LCA with the previous leaf is new
+        union_nodes += depth_b - lca_depth;
+    }
+    return static_cast<int>(union_nodes - 2 * static_cast<long long>(leaves.size()) + 1);
+}
+
+long long subtree_leaf_count(long long index, long long num_leaf) {
+    // The subtree covers [index * 2^k, (index + 1) * 2^k - 1] on each relative level k;
+    // leaves are the nodes of [num_leaf, 2 * num_leaf - 1] there, on at most two levels
+    long long count = 0;
+    long long first = index;
+    long long last = index;
+    while (first <= 2 * num_leaf - 1) {
+        long long low = std::max(first, num_leaf);
+        long long high = std::min(last, 2 * num_leaf - 1);
+        if (low <= high) {
+            count += high - low + 1;
+        }
+        first = 2 * first;
+        last = 2 * last + 1;
+    }
+    return count;
+}
@@ -8,6 +8,7 @@
 #include <numeric> // For std::accumulate
 #include <tuple>   // For std::tuple
 #include <optional> // For decrease_config return
+#include <cstddef>  // For std::size_t
 
 // Define Config as a type alias for clarity
 using Config = std::vector<std::pair<int, int>>;
@@ -77,6 +78,70 @@ Config add_config(const Config& config1, const Config& config2);
  */
 std::optional<Config> decrease_config(const Config& config, int num_leaf);
 
+/**
+ * @brief Splits one subtree of a configuration, i.e. decrease_config followed by add_config.
+ *
+ * Works on raw sorted arrays and writes into a caller-owned buffer, so the step loop
+ * can build successor configs without going through ConfigMap.
+ * @param config Pointer to the sorted (subtree_size, num_subtree) pairs.
+ * @param len Number of pairs in config.
+ * @param split_index Index of the pair whose count is decreased by one.
+ * @param split The configuration produced by splitting that subtree (sorted).
+ * @param out Receives the resulting sorted configuration.
+ */
+void apply_split(const std::pair<int, int>* config, std::size_t len, std::size_t split_index,
+                 const Config& split, Config& out);
+
+/**
+ * @brief apply_split with the split result given as a raw sorted array (see SplitTable).
+ */
+void apply_split(const std::pair<int, int>* config, std::size_t len, std::size_t split_index,
+                 const std::pair<int, int>* split, std::size_t split_len, Config& out);
+
+/**
+ * @brief Like apply_split, but two subtrees are removed before the split result is added.
+ * @param config Pointer to the sorted (subtree_size, num_subtree) pairs.
+ * @param len Number of pairs in config.
+ * @param first_index Index of the first removed subtree size.
+ * @param second_index Index of the second one; may equal first_index to remove two of the same size.
+ * @param split The combined configuration produced by splitting both subtrees (sorted).
+ * @param out Receives the resulting sorted configuration.
+ */
+void apply_double_split(const std::pair<int, int>* config, std::size_t len,
+                        std::size_t first_index, std::size_t second_index,
+                        const Config& split, Config& out);
+
+/**
+ * @brief Counts the revealed (co-path) nodes when a set of distinct leaves is opened.
+ *
+ * Leaves are heap indices in [num_leaf, 2 * num_leaf - 1] of the tree whose root is 1 and
+ * whose node i has children 2i and 2i + 1, the tree sample_once splits. The union of the
+ * root paths is computed by sorting the leaves in DFS order and subtracting the depth of
+ * each neighbouring pair's LCA, both with shifts and count-leading-zeros only. With M nodes
+ * on the union, the revealed nodes are the M - 2 * n + 1 children of union nodes that are
+ * not on the union themselves.
+ * @param leaves The opened leaves; reordered in place.
+ * @param num_leaf Number of leaves of the tree.
+ * @return The number of revealed nodes (1 if no leaf is opened: the root).
+ */
+int count_copath_nodes(std::vector<long long>& leaves, long long num_leaf);
+
+/**
+ * @brief Number of leaves below a node of the heap-layout tree with num_leaf leaves.
+ * @param index Heap index of the node (root 1); leaves are [num_leaf, 2 * num_leaf - 1].
+ * @param num_leaf Number of leaves of the tree.
+ * @return The leaf count of the subtree rooted at index (1 for a leaf).
+ */
+long long subtree_leaf_count(long long index, long long num_leaf);
+
+/**
+ * @brief Depth of a node of the heap-layout tree (root 1 at depth 0), from count-leading-zeros.
+ * @param index Heap index of the node; must be positive.
+ */
+inline int heap_depth(long long index) {
+    return 63 - __builtin_clzll(static_cast<unsigned long long>(index));
+}
+
 /**
  * @brief Calculates the histogram of the total number of nodes from a distribution.
  * @param dist A map where keys are configurations and values are probabilities.
@@ -0,0 +1,262 @@
+#include "tuning.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio> // For std::rename, std::sscanf
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::string trim(const std::string& text) {
+    std::size_t begin = text.find_first_not_of(" \t");
+    std::size_t end = text.find_last_not_of(" \t\r\n");
+    return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+}
+
+// Creates every missing directory on the way to path's parent
+void make_parent_dirs(const std::string& path) {
+    for (std::size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        std::string dir = path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::runtime_error("Cannot create " + dir + ": " + std::strerror(errno));
+        }
+    }
+}
+
+// Fastest of repeats runs of sample(num_leaf, steps, options), in seconds
+double time_steps(int num_leaf, int steps, const EngineOptions& options, int repeats = 3) {
+    using namespace std::chrono;
+    double best = 0;
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        auto start = steady_clock::now();
+        sample(num_leaf, steps, options);
+        double seconds = duration<double>(steady_clock::now() - start).count();
+        best = repeat == 0 ? seconds : std::min(best, seconds);
+    }
+    return best;
+}
+
+} // namespace
+
+MachineKey MachineKey::current() {
+    MachineKey key;
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    key.host = host;
+    key.cpu = "unknown";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos) {
+            key.cpu = trim(line.substr(line.find(':') + 1));
+            break;
+        }
+    }
+    return key;
+}
+
+std::string format_tuning(const EngineOptions& options) {
+    std::ostringstream text;
+    text << "batch=" << options.insert_batch << " load=" << options.max_load_percent
+         << " arena_kb=" << options.arena_block_bytes / 1024 << " fuse2=" << (options.fuse_two_picks ? 1 : 0)
+         << " hugepages=" << hugepage_policy_name(options.hugepages);
+    if (options.pipeline_expanders > 0) {
+        text << " pipeline=" << options.pipeline_expanders << ":" << options.pipeline_aggregators;
+    }
+    return text.str();
+}
+
+bool parse_tuning(const std::string& text, EngineOptions& options) {
+    EngineOptions parsed = options;
+    std::istringstream in(text);
+    std::string field;
+    while (in >> field) {
+        std::size_t eq = field.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        std::string name = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+        char* end = nullptr;
+        long number = std::strtol(value.c_str(), &end, 10);
+        bool is_number = !value.empty() && *end == '\0';
+        if (name == "batch" && is_number && number >= 1) {
+            parsed.insert_batch = static_cast<int>(number);
+        } else if (name == "load" && is_number && number >= 10 && number <= 90) {
+            parsed.max_load_percent = static_cast<int>(number);
+        } else if (name == "arena_kb" && is_number && number >= 4) {
+            parsed.arena_block_bytes = static_cast<std::size_t>(number) * 1024;
+        } else if (name == "fuse2" && is_number) {
+            parsed.fuse_two_picks = number != 0;
+        } else if (name == "hugepages" && parse_hugepage_policy(value, parsed.hugepages)) {
+            // Parsed in the condition
+        } else if (name == "pipeline" && std::sscanf(value.c_str(), "%d:%d", &parsed.pipeline_expanders,
+                                                     &parsed.pipeline_aggregators) == 2
+                   && parsed.pipeline_expanders >= 1 && parsed.pipeline_aggregators >= 1) {
+            // Parsed in the condition
+        } else {
+            return false;
+        }
+    }
+    options = parsed;
+    return true;
+}
+
+std::string default_tuning_path() {
+    if (const char* path = std::getenv("OTS_TUNING_FILE")) {
+        return path;
+    }
+    if (const char* cache = std::getenv("XDG_CACHE_HOME")) {
+        return std::string(cache) + "/ots_sampler/tuning.tsv";
+    }
+    const char* home = std::getenv("HOME");
+    return std::string(home != nullptr ? home : ".") + "/.cache/ots_sampler/tuning.tsv";
+}
+
+bool load_tuning(const std::string& path, const MachineKey& machine, EngineOptions& options) {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::size_t first_tab = line.find('\t');
+        std::size_t second_tab = first_tab == std::string::npos ? first_tab : line.find('\t', first_tab + 1);
+        if (second_tab == std::string::npos) continue;
+        if (line.compare(0, first_tab, machine.host) == 0 && first_tab == machine.host.size()
+            && line.substr(first_tab + 1, second_tab - first_tab - 1) == machine.cpu) {
+            if (!parse_tuning(line.substr(second_tab + 1), options)) {
+                std::cerr << "Ignoring malformed tuning in " << path << ": " << line << std::endl;
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void save_tuning(const std::string& path, const MachineKey& machine, const EngineOptions& options) {
+    std::string prefix = machine.host + "\t" + machine.cpu + "\t";
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.compare(0, prefix.size(), prefix) != 0) {
+                lines.push_back(line); // Other machines sharing the file keep their lines
+            }
+        }
+    }
+    lines.push_back(prefix + format_tuning(options));
+
+    make_parent_dirs(path);
+    std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const std::string& line : lines) {
+            out << line << '\n';
+        }
+        if (!out.flush()) {
+            throw std::runtime_error("Cannot write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot rename " + tmp + ": " + std::strerror(errno));
+    }
+}
+
+EngineOptions autotune(int num_leaf, int tau, const EngineOptions& start, std::vector<TuneTrial>& trials) {
+    if (num_leaf <= 0 || tau < 2) {
+        throw std::invalid_argument("Autotuning needs at least two picks");
+    }
+    EngineOptions base = start;
+    base.approx_cutoff = 0; // Tune the exact engine without side effects
+    base.compress_frontier = false;
+    base.checkpoint_path.clear();
+    base.resume_path.clear();
+    base.quiet = true; // Each trial would print its own progress and telemetry report
+
+    // Enough steps for the frontier to outgrow the caches, but short enough to repeat often
+    int steps = 2;
+    while (steps < tau && time_steps(num_leaf, steps, base, 1) < 0.2) {
+        ++steps;
+    }
+    std::cerr << "Autotune: " << steps << " steps of L = " << num_leaf << " per trial" << std::endl;
+
+    EngineOptions best = base;
+    double best_seconds = time_steps(num_leaf, steps, best);
+    trials.push_back({best, best_seconds});
+
+    auto try_knob = [&](auto&& set, const auto& values) {
+        bool improved = false;
+        for (const auto& value : values) {
+            EngineOptions candidate = best;
+            set(candidate, value);
+            if (format_tuning(candidate) == format_tuning(best)) continue;
+            double seconds = time_steps(num_leaf, steps, candidate);
+            trials.push_back({candidate, seconds});
+            if (seconds < best_seconds * 0.97) { // Ignore differences within timing noise
+                best = candidate;
+                best_seconds = seconds;
+                improved = true;
+            }
+        }
+        return improved;
+    };
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool improved = false;
+        improved |= try_knob([](EngineOptions& o, HugePagePolicy p) { o.hugepages = p; },
+                             std::vector<HugePagePolicy>{HugePagePolicy::Off, HugePagePolicy::Madvise});
+        improved |= try_knob([](EngineOptions& o, int b) { o.insert_batch = b; }, std::vector<int>{1, 8, 16, 32, 64, 128});
+        improved |= try_knob([](EngineOptions& o, int l) { o.max_load_percent = l; }, std::vector<int>{35, 50, 65, 80});
+        improved |= try_knob([](EngineOptions& o, std::size_t a) { o.arena_block_bytes = a; },
+                             std::vector<std::size_t>{kHugePageSize, 4 * kHugePageSize, 16 * kHugePageSize});
+        if (base.pipeline_expanders > 0) {
+            // The pipeline runs single picks only; its thread split is the knob instead
+            int threads = base.pipeline_expanders + base.pipeline_aggregators;
+            std::vector<int> expanders;
+            for (int e = 1; e < threads; ++e) {
+                expanders.push_back(e);
+            }
+            improved |= try_knob([threads](EngineOptions& o, int e) {
+                o.pipeline_expanders = e;
+                o.pipeline_aggregators = threads - e;
+            }, expanders);
+        } else {
+            improved |= try_knob([](EngineOptions& o, bool f) { o.fuse_two_picks = f; }, std::vector<bool>{false, true});
+        }
+        if (!improved) break;
+    }
+
+    // Single timings can win by noise; the winner has to beat the start again, interleaved
+    if (format_tuning(best) != format_tuning(base)) {
+        double base_seconds = 0, tuned_seconds = 0;
+        for (int round = 0; round < 5; ++round) {
+            double b = time_steps(num_leaf, steps, base, 1);
+            double t = time_steps(num_leaf, steps, best, 1);
+            base_seconds = round == 0 ? b : std::min(base_seconds, b);
+            tuned_seconds = round == 0 ? t : std::min(tuned_seconds, t);
+        }
+        std::cerr << "Autotune: start " << base_seconds << " s, tuned " << tuned_seconds << " s" << std::endl;
+        if (tuned_seconds >= base_seconds * 0.97) {
+            best = base; // Not reproducibly faster
+        }
+    }
+
+    // Knobs outside the search come back as the caller had them
+    EngineOptions result = start;
+    result.hugepages = best.hugepages;
+    result.insert_batch = best.insert_batch;
+    result.max_load_percent = best.max_load_percent;
+    result.arena_block_bytes = best.arena_block_bytes;
+    result.fuse_two_picks = best.fuse_two_picks;
+    result.pipeline_expanders = best.pipeline_expanders;
+    result.pipeline_aggregators = best.pipeline_aggregators;
+    return result;
+}
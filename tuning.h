@@ -0,0 +1,82 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "sampler.h" // For EngineOptions
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Identifies the machine a tuning was measured on.
+ */
+struct MachineKey {
+    std::string host; // gethostname()
+    std::string cpu;  // "model name" from /proc/cpuinfo, or "unknown"
+
+    /**
+     * @brief Returns the key of the machine this process runs on.
+     */
+    static MachineKey current();
+};
+
+/**
+ * @brief Formats the tunable knobs of options, e.g. "batch=32 load=50 arena_kb=8192 fuse2=0 hugepages=madvise".
+ *
+ * " pipeline=E:A" is appended when options use the pipeline.
+ */
+std::string format_tuning(const EngineOptions& options);
+
+/**
+ * @brief Applies knobs written by format_tuning to options. Returns false if the text is malformed.
+ */
+bool parse_tuning(const std::string& text, EngineOptions& options);
+
+/**
+ * @brief Default location of the tuning file.
+ *
+ * $OTS_TUNING_FILE if set, else $XDG_CACHE_HOME/ots_sampler/tuning.tsv, else
+ * $HOME/.cache/ots_sampler/tuning.tsv.
+ */
+std::string default_tuning_path();
+
+/**
+ * @brief Loads the tuning saved for machine, if any.
+ *
+ * The file holds one line per machine: host, CPU model and format_tuning text,
+ * separated by tabs.
+ * @return True if a line for machine was found and applied to options.
+ */
+bool load_tuning(const std::string& path, const MachineKey& machine, EngineOptions& options);
+
+/**
+ * @brief Saves the tuning of machine, replacing its previous line.
+ *
+ * The file is rewritten through a temporary file and rename. Throws std::runtime_error on I/O errors.
+ */
+void save_tuning(const std::string& path, const MachineKey& machine, const EngineOptions& options);
+
+/**
+ * @brief One timed configuration of the search.
+ */
+struct TuneTrial {
+    EngineOptions options;
+    double seconds; // Fastest of the repeats
+};
+
+/**
+ * @brief Searches the engine knobs on this machine.
+ *
+ * Times sample(num_leaf, steps) with steps grown from 2 until one run takes about
+ * 0.2 s (at most tau), then does coordinate descent over the huge page policy, the
+ * insert batch, the maximum load, the arena block size and two-pick fusion (with a
+ * pipeline in start: its split of the same number of threads instead), keeping
+ * a change only if it is at least 3% faster. Each configuration is timed three times
+ * (fastest run). The winner is then timed against the start in five interleaved rounds
+ * and dropped unless it is still 3% faster.
+ * @param start The configuration the search starts from (and falls back to).
+ * @param trials Receives every timed configuration, in order.
+ * @return The fastest configuration found.
+ */
+EngineOptions autotune(int num_leaf, int tau, const EngineOptions& start, std::vector<TuneTrial>& trials);
+
+#endif // TUNING_H
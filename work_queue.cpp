@@ -0,0 +1,192 @@
+#include "work_queue.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>   // For std::rename
+#include <cstring>  // For std::strerror
+#include <ctime>
+#include <dirent.h>
+#include <exception>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> list_dir(const std::string& path) {
+    std::vector<std::string> names;
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        throw std::runtime_error("Cannot open queue directory " + path + ": " + std::strerror(errno));
+    }
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != ".." && name.find(".tmp") == std::string::npos) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Writes text to path through a temporary file and rename, so readers never see a partial file
+void publish_file(const std::string& path, const std::string& owner, const std::string& text) {
+    std::string tmp = path + "." + owner + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << text << '\n';
+        if (!out) {
+            throw std::runtime_error("Cannot write " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot rename " + tmp + ": " + std::strerror(errno));
+    }
+}
+
+std::string owner_id() {
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host) + "-" + std::to_string(getpid());
+}
+
+// Renews a lease by setting its mtime to now until stopped
+class Heartbeat {
+public:
+    Heartbeat(const std::string& lease_path, int lease_seconds)
+        : path_(lease_path), interval_(std::chrono::seconds(lease_seconds) / 3), thread_([this] { run(); }) {}
+
+    ~Heartbeat() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!wake_.wait_for(lock, interval_, [this] { return stop_; })) {
+            if (utimensat(AT_FDCWD, path_.c_str(), nullptr, 0) != 0 && errno == ENOENT) {
+                // Reclaimed by another worker; the point still finishes here, possibly twice
+                std::cerr << "Lease lost: " << path_ << std::endl;
+                return;
+            }
+        }
+    }
+
+    std::string path_;
+    std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+// Returns expired leases to pending/; returns the number of leases still held
+std::size_t reclaim_expired(const std::string& dir, int lease_seconds) {
+    std::size_t held = 0;
+    std::time_t now = std::time(nullptr);
+    for (const std::string& lease : list_dir(dir + "/leased")) {
+        std::string path = dir + "/leased/" + lease;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue; // Finished or reclaimed meanwhile
+        }
+        if (now - st.st_mtime <= lease_seconds) {
+            ++held;
+            continue;
+        }
+        std::string name = lease.substr(0, lease.find('@'));
+        // Only one reclaimer's rename succeeds
+        if (std::rename(path.c_str(), (dir + "/pending/" + name).c_str()) == 0) {
+            std::cerr << "Reclaimed expired lease " << lease << std::endl;
+        }
+    }
+    return held;
+}
+
+} // namespace
+
+std::string SweepPoint::name() const {
+    return "csp" + std::to_string(csp) + "_tau" + std::to_string(tau) + "_w" + std::to_string(w_grind);
+}
+
+bool SweepPoint::parse(const std::string& name, SweepPoint& point) {
+    int consumed = 0;
+    if (std::sscanf(name.c_str(), "csp%d_tau%d_w%d%n", &point.csp, &point.tau, &point.w_grind, &consumed) != 3) {
+        return false;
+    }
+    return static_cast<std::size_t>(consumed) == name.size();
+}
+
+int run_queue_worker(const std::string& dir, const QueueOptions& options,
+                     const std::function<std::string(const SweepPoint&)>& run) {
+    std::string owner = owner_id();
+    int finished = 0;
+    while (true) {
+        // Claim the first pending point another worker does not take first
+        std::string name;
+        std::string lease;
+        for (const std::string& candidate : list_dir(dir + "/pending")) {
+            std::string candidate_lease = dir + "/leased/" + candidate + "@" + owner;
+            if (std::rename((dir + "/pending/" + candidate).c_str(), candidate_lease.c_str()) == 0) {
+                // rename() keeps the pending file's mtime, which may be long past; renew at once
+                // so other workers do not take the fresh lease for an expired one
+                utimensat(AT_FDCWD, candidate_lease.c_str(), nullptr, 0);
+                name = candidate;
+                lease = candidate_lease;
+                break;
+            }
+        }
+
+        if (name.empty()) {
+            if (reclaim_expired(dir, options.lease_seconds) == 0 && list_dir(dir + "/pending").empty()) {
+                break; // Nothing pending and nobody working: the sweep is done
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(options.poll_seconds));
+            continue;
+        }
+
+        SweepPoint point;
+        if (!SweepPoint::parse(name, point)) {
+            publish_file(dir + "/failed/" + name, owner, "Not a sweep point name");
+            std::remove(lease.c_str());
+            continue;
+        }
+        if (exists(dir + "/results/" + name)) {
+            std::remove(lease.c_str()); // Finished by the previous holder after all
+            continue;
+        }
+
+        std::cerr << owner << " running " << name << std::endl;
+        try {
+            std::string result;
+            {
+                Heartbeat heartbeat(lease, options.lease_seconds);
+                result = run(point);
+            }
+            publish_file(dir + "/results/" + name, owner, result);
+            ++finished;
+        } catch (const std::exception& e) {
+            std::cerr << "Error in " << name << ": " << e.what() << std::endl;
+            publish_file(dir + "/failed/" + name, owner, e.what());
+        }
+        std::remove(lease.c_str());
+    }
+    return finished;
+}
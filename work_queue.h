@@ -0,0 +1,62 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <functional>
+#include <string>
+
+/**
+ * @brief One point of a parameter sweep.
+ */
+struct SweepPoint {
+    int csp = 0;
+    int tau = 0;
+    int w_grind = 0;
+
+    /**
+     * @brief File name of the point in the queue directory, e.g. "csp128_tau12_w0".
+     */
+    std::string name() const;
+
+    /**
+     * @brief Parses a name written by name(). Returns false if it is not a point name.
+     */
+    static bool parse(const std::string& name, SweepPoint& point);
+};
+
+/**
+ * @brief Tuning of a queue worker.
+ */
+struct QueueOptions {
+    int lease_seconds = 300; // A lease not renewed for this long is returned to pending/
+    int poll_seconds = 5;    // Wait between scans while other workers still hold leases
+};
+
+/**
+ * @brief Runs sweep points from a shared directory until none are left.
+ *
+ * Layout of dir (created by batch_run.py --queue-dir):
+ *   pending/NAME         points nobody works on
+ *   leased/NAME@OWNER    points claimed by OWNER (host-pid); the mtime is the last renewal
+ *   results/NAME         the CSV line of a finished point
+ *   failed/NAME          the error message of a point that threw
+ *
+ * A worker claims a point by renaming pending/NAME to leased/NAME@OWNER. rename() is
+ * atomic within a file system, including NFS, so exactly one worker wins. The winner
+ * sets the lease mtime to now at once (rename keeps the old one), and while the point
+ * runs, a heartbeat thread touches the lease every lease_seconds / 3. Any worker that finds
+ * no pending point renames leases older than lease_seconds back to pending/, so the points
+ * of crashed or partitioned workers are picked up again. Results are written to a temporary
+ * file and renamed into results/. If a point is finished twice after a reclaim, both
+ * writers produce the same line.
+ *
+ * Hosts compare lease mtimes with their own clock, so lease_seconds must exceed the clock
+ * skew between hosts by a wide margin.
+ * @param dir The shared queue directory.
+ * @param options Lease and polling intervals.
+ * @param run Computes the result line of a point; exceptions are recorded in failed/.
+ * @return The number of points this worker finished.
+ */
+int run_queue_worker(const std::string& dir, const QueueOptions& options,
+                     const std::function<std::string(const SweepPoint&)>& run);
+
+#endif // WORK_QUEUE_H